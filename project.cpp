@@ -5,6 +5,7 @@
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <fstream>
 #include <bitset>
 #include <numeric>
 #include <algorithm>
@@ -21,21 +22,102 @@
 #include "exprtk.hpp"
 // Threading for non-blocking console input
 #include <thread>
+#include <chrono>
 #include <mutex>
 #include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <deque>
+#include <stdexcept>
+#include <cctype>
+#include <cstring>
+#include <limits>
+// SIMD intrinsics for the level-set bytecode
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+// Worker pool for grid evaluation
+#include <condition_variable>
+#include <functional>
+// Aligned field storage and packed phase bitsets
+#include <new>
+#include <type_traits>
+#include <cstdint>
+// Native level-set kernels, compile with -DJIT to build them with the local compiler in the background
+#ifdef JIT
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+// Disk cache of sampled fields, on POSIX systems unless compiled with -DNO_DISK_CACHE
+#if !defined(NO_DISK_CACHE) && (defined(__unix__) || defined(__APPLE__))
+#define DISK_CACHE
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 //  Default resolution
 //  For Retina displays compile with -DRES=2
 #ifndef RES
 #define RES 1
 #endif
+//  The level-set bytecode uses SSE2 by default, compile with -mavx2 (or -march=native) to use AVX2
+//  Number of grid evaluation threads
+//  0 uses every hardware thread, compile with e.g. -DNUM_THREADS=8 to fix the count
+#ifndef NUM_THREADS
+#define NUM_THREADS 0
+#endif
+//  Sampled fields are stored as doubles, compile with -DFIELD_FLOAT to store them as floats,
+//  which halves their memory and bandwidth. Evaluation is always done in double precision
+//  Compiler command and libraries for native level-set kernels (only used with -DJIT)
+#ifndef JIT_COMPILER
+#define JIT_COMPILER "g++ -O3 -march=native -fno-math-errno -ffp-contract=off -fopenmp-simd -fPIC -shared"
+#endif
+#ifndef JIT_LIBS
+#if defined(__x86_64__) && defined(__GLIBC__)
+#define JIT_LIBS "-lmvec -lm" // glibc's vector math library
+#else
+#define JIT_LIBS "-lm"
+#endif
+#endif
 
 #define NUM_POINTS 300             // number of points in each direction for the grid
+#define PLOT_STRIDE 3              // the level-set plotter samples every PLOT_STRIDE-th grid point
 #define MAX_GEOMETRIES 5           // Maximum number of geometries
+#define FIELD_CACHE_SIZE 20        // number of sampled fields kept in the field cache
+#define ROWS_PER_TASK 4            // grid rows evaluated by one worker task
+#define FIELD_ALIGNMENT 64         // alignment of sampled fields in bytes, a cache line
+#define VM_BLOCK 8                 // points evaluated by every level-set bytecode instruction
+#define SIGN_TILE 16               // grid cells per side of the tiles whose sign is bounded by interval arithmetic
+#define SCENE_CACHE_SIZE 4         // number of level-set groups whose shared bytecode is kept
+#define LS_CACHE_SIZE 32           // number of parsed level-set functions kept for reuse
+#define MAX_PARAMETERS 16          // Maximum number of named level-set parameters
+#define PARAMETER_STEP 0.01        // '[' and ']' change the active parameter by this fraction of the domain width
+#define SCROLL_STEP 0.05           // z-slice step of the mouse wheel
+#define VOLUME_SLICES 2            // wheel steps above and below the current z-slice that are sampled in the background
+#define VOLUME_POINTS 64           // number of points in each direction of the volume grid of the 3-D view
+#define VOLUME_CACHE_SIZE 8        // number of sampled volumes kept, at least MAX_GEOMETRIES
+#define QUADTREE_BASE 5            // the overlay quadtree starts from 2^QUADTREE_BASE cells in each direction
+#define QUADTREE_DEPTH 10          // finest level of the overlay quadtree at startup
+#define QUADTREE_MAX_DEPTH 15      // finest level the '>' key can select
+#define QUADTREE_MARGIN 1.5        // safety factor on how far the interface may be from a quadtree cell center to split it
+#define QUADTREE_CACHE_SIZE 8      // number of refined overlay interfaces kept
+#define ROOT_TOLERANCE 1e-4        // interface roots are found to this distance along the grid edge
+#define ROOT_BUDGET 12             // maximum level-set evaluations spent on one interface root
+#define DISK_CACHE_ENTRIES 64      // sampled fields kept on disk between runs, at most 720 KB each
+#define DISK_CACHE_PENDING 8       // fields waiting to be written to disk, the oldest are dropped beyond this
+#define DISK_CACHE_FRAMES 60       // fields are only written to disk once they are still in use this many frames after sampling
 #define MORIS_UINT_MAX 4294967295u // Maximum value for an uint, remove this for final moris build
 
-using LS = exprtk::expression<double>; // Level set function type - returns phi(x,y,z)
-using Bitset = std::vector<int>;       // Bitset type for phase representation
+using Bitset = std::uint8_t; // Signs of all geometries packed into one word, geometry 0 in the most significant bit
 typedef unsigned int uint;
+static_assert(MAX_GEOMETRIES <= 8, "A Bitset holds one bit per geometry");
 
 namespace moris::GUI
 {
@@ -51,938 +133,7119 @@ namespace moris::GUI
    };
 
    //-----------------------------------------------------------
-   // Global projection variables
-   //-----------------------------------------------------------
-
-   double gAsp = 16.0 / 9.0; // Aspect ratio
-   double gDim = 2.0;        // Size of the world
-   int gPhi = 20;            // Elevation of view angle
-   int gTheta = 0;           // Azimuth of view angle
-
-   // Saved matrices / viewport for accurate gluUnProject (main view)
-   GLdouble gModelviewMain[16];
-   GLdouble gProjectionMainMatrix[16];
-   GLint gViewportMain[4];
-
-   //-----------------------------------------------------------
-   // Global lighting variables
-   //-----------------------------------------------------------
-   int gLight = 1;     // Lighting on or off
-   int gSmooth = 1;    // Smooth/Flat shading
-   int gMoveLight = 1; // Move light in idle or not
-
-   int gDistance = 2;       // Light distance
-   int gBallIncrement = 10; // Ball increment
-   int gEmission = 0;       // Emission intensity (%)
-   int gAmbient = 5;        // Ambient intensity (%)
-   int gDiffuse = 50;       // Diffuse intensity (%)
-   int gSpecular = 30;      // Specular intensity (%)
-   int gShininess = 0;      // Shininess (power of two)
-   double gShiny = 1;       // Shininess (value)
-   int gZeta = 160;         // Light azimuth
-   float gYLight = 1;       // Elevation of light
-
-   //-----------------------------------------------------------
-   // Global texture variables
-   //-----------------------------------------------------------
-   uint gTexture[1]; //  Texture names
-   uint gScroll = 0; // Texture scrolling in idle
-
-   //-----------------------------------------------------------
-   // Global mouse variables
-   //-----------------------------------------------------------
-
-   int gMouseX = 0, gMouseY = 0; // Current mouse position
-   int gMouseCaptured = 0;       // Whether mouse is captured for camera control
-
-   //-----------------------------------------------------------
-   // Global LS variables
+   // Scene state
    //-----------------------------------------------------------
-   int gSpatialDim = 2;                        // Spatial dimension (2D/3D)
-   int gAxes = 1;                              // Display axes or not
-   double gXLB = -1.0;                         // x lower bound
-   double gXUB = 1.0;                          // x upper bound
-   double gZLB = -1.0;                         // z lower bound
-   double gZUB = 1.0;                          // z upper bound
-   double gScaleX = 1.0;                       // Scale factor for zooming
-   double gScaleZ = 1.0;                       // Scale factor for zooming
-   double gX, gY, gZ;                          // Global coordinates for LS evaluation
-   std::vector<LS> gLevelSets(MAX_GEOMETRIES); // Vector of level-set functions
-   uint gActiveGeometry = MORIS_UINT_MAX;      // Currently active geometry for user input
-   uint gNumGeoms = 0;                         // Number of geometries defined
-
-   std::vector<double> gXVals(NUM_POINTS); // X values for grid
-   std::vector<double> gZVals(NUM_POINTS); // Z values for grid
 
-   std::mutex gLevelSetMutex; // Mutex to protect level-set updates from background input threads
-
-   bool gIsocontour = true; // Flag to plot isocontour points
-
-   //-----------------------------------------------------------
-   // Global phase variables
-   //-----------------------------------------------------------
+   /**
+    * Components of the scene that cached results depend on
+    */
+   enum class SCENE
+   {
+      GEOMETRY,   // Level-set functions and number of geometries
+      PARAMETERS, // Values of the level-set parameters
+      SLICE,      // Current z-slice
+      PHASES,     // Phase table, phases to plot and sign conditions to plot of every geometry
+      ISOCONTOUR, // Isocontour flag
+      NUM_COMPONENTS
+   };
 
-   // Phase table: initialize with values 0,1,2,...,(2^MAX_GEOMETRIES)-1
-   std::vector<int> gPhaseTable = []()
+   /**
+    * Generation counter of every scene component. Whatever changes a component touches it afterwards, from any thread.
+    * The render path reads the counters without locking, and a cached result is up to date as long as the
+    * generations of its inputs are the ones it was built from
+    */
+   class SceneState
    {
-      int n = 1 << MAX_GEOMETRIES; // 2^MAX_GEOMETRIES
-      std::vector<int> v(n);
-      std::iota(v.begin(), v.end(), 0);
-      return v;
-   }();
-   std::vector<PHASE> gGeomsPhaseToPlot(MAX_GEOMETRIES, PHASE::NONE); // 0 = don't plot, 1 = plot positive, -1 = plot negative, 2 = plot both
-   std::vector<int> gPhasesToPlot = gPhaseTable;                      // Phases to plot
+    public:
+      /**
+       * Marks a component as changed, call after the change is made
+       */
+      void touch(SCENE aComponent)
+      {
+         mGenerations[static_cast<uint>(aComponent)].fetch_add(1, std::memory_order_release);
+      }
 
-   // Colors for each geometry (Paraview KAAMS color scheme)
-   std::vector<std::vector<double>> gColors = {
-       {1.0, 1.0, 1.0},
-       {1.0, 0.0, 0.0},
-       {0.0, 1.0, 0.0},
-       {0.0, 0.0, 1.0},
-       {1.0, 1.0, 0.0},
-       {0.0, 1.0, 1.0},
-       {1.0, 0.0, 1.0},
-       {0.5, 0.5, 0.5},
-       {1.0, 0.5, 0.0},
-       {0.5, 0.0, 0.5}};
+      /**
+       * Generations of several components, read before the components themselves
+       */
+      std::vector<uint> generations(std::initializer_list<SCENE> aComponents) const
+      {
+         std::vector<uint> tGenerations;
+         tGenerations.reserve(aComponents.size());
+         for (SCENE tComponent : aComponents)
+         {
+            tGenerations.push_back(mGenerations[static_cast<uint>(tComponent)].load(std::memory_order_acquire));
+         }
+         return tGenerations;
+      }
 
-   uint gSelectedBitset = MORIS_UINT_MAX; // Currently selected bitset (gets a texture). MORIS_UINT_MAX means none selected
+    private:
+      std::atomic<uint> mGenerations[static_cast<uint>(SCENE::NUM_COMPONENTS)] = {};
+   };
 
-   // Mutex to protect updates to the phase table when using a background input thread
-   std::mutex gPhaseTableMutex;
+   SceneState gScene; // Generations of the scene components
 
    //-----------------------------------------------------------
-   // Global viewport variables
+   // Level-set parameters
    //-----------------------------------------------------------
 
-   bool gProjectionMain = true; // Flag to change main viewport to projection view
-   int gWidth = 1920 / RES;     // Main window width
-   int gHeight = 1080 / RES;    // Main window height
-
-   int gProjWidth = 0.3 * gWidth;   // Projection viewport width
-   int gProjHeight = 0.3 * gHeight; // Projection viewport height
-   float gProjY = 0.0f;             // Projection viewport Y position
-
-   //-----------------------------------------------------------------------
+   // Named parameters of the level-set functions, such as a radius r. A symbol of an expression that isn't a coordinate,
+   // an exprtk constant or a registered parameter becomes a new parameter, but only one per expression and not where it is
+   // called like a function, so typos are still parse errors. Parameters are never removed, so expressions bind to their
+   // values once and see every change without being parsed again
+   std::string gParameterNames[MAX_PARAMETERS];   // Lowercase names of the registered parameters
+   double gParameterValues[MAX_PARAMETERS];       // Current values of the registered parameters
+   std::atomic<uint> gNumParameters{0};           // Number of registered parameters
+   std::mutex gParameterMutex;                    // Mutex to protect registering parameters from the input threads
+   std::mutex gParameterValuesMutex;              // Held while parameter values change, and by the slice sampler while it samples
+   uint gActiveParameter = MORIS_UINT_MAX;        // Parameter changed by the '[' and ']' keys
 
    /**
-    * Fills a vector with linearly spaced values between start and end.
-    * The vector must be pre-sized to the desired number of points
+    * Gets the index of a parameter, MORIS_UINT_MAX if there is none with that name. Callers hold gParameterMutex
     */
-   void linspace(std::vector<double> &aVec, double start, double end)
+   uint find_parameter(const std::string &aName)
    {
-      uint num = aVec.size();
-      double step = (end - start) / (num - 1);
-      for (uint i = 0; i < num; i++)
+      std::string tName = aName;
+      std::transform(tName.begin(), tName.end(), tName.begin(), [](unsigned char c)
+                     { return std::tolower(c); });
+      for (uint iParameter = 0; iParameter < gNumParameters; iParameter++)
       {
-         aVec[i] = start + i * step;
+         if (gParameterNames[iParameter] == tName)
+         {
+            return iParameter;
+         }
       }
+      return MORIS_UINT_MAX;
    }
 
    //-----------------------------------------------------------------------
 
-   // Evaluate level-set function at given coordinates
-   double eval_LS(const LS &aLS, double aX, double aY, double aZ = 0.0f)
+   /**
+    * Registers a parameter with a value of 1 unless it already exists. Returns its index,
+    * or MORIS_UINT_MAX if there are already MAX_PARAMETERS parameters
+    */
+   uint add_parameter(const std::string &aName)
    {
-      // Set global coordinates
-      gX = aX;
-      gY = aY;
-      gZ = aZ;
+      std::lock_guard<std::mutex> lock(gParameterMutex);
+      uint tIndex = find_parameter(aName);
+      if (tIndex != MORIS_UINT_MAX || gNumParameters == MAX_PARAMETERS)
+      {
+         return tIndex;
+      }
 
-      // Evaluate expression
-      return aLS.value();
+      tIndex = gNumParameters;
+      gParameterNames[tIndex] = aName;
+      std::transform(aName.begin(), aName.end(), gParameterNames[tIndex].begin(), [](unsigned char c)
+                     { return std::tolower(c); });
+      gParameterValues[tIndex] = 1.0;
+      gNumParameters++;
+      std::cout << "New parameter " << gParameterNames[tIndex] << " = 1, set it with k\n";
+      return tIndex;
    }
 
    //-----------------------------------------------------------------------
 
    /**
-    * Bisection method to find root of level-set function along one dimension
+    * Whether a name appears in an expression followed by an opening parenthesis, like a function call
     */
-   double bisect(const LS &aLS, double a, double b, double y, double tol = 1e-4)
+   bool called_as_function(const std::string &aSource, const std::string &aName)
    {
-      double tMidPoint = 0.5 * (a + b);
-
-      if (std::abs(b - a) < tol)
+      auto tIsWord = [](char c)
       {
-         return tMidPoint;
-      }
-      else if (eval_LS(aLS, a, y, gZ) * eval_LS(aLS, tMidPoint, y, gZ) < 0)
+         return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+      };
+      auto tSameLetter = [](char a, char b)
       {
-         return bisect(aLS, a, tMidPoint, y, tol);
-      }
-      else
+         return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+      };
+
+      for (auto iStart = aSource.begin(); iStart != aSource.end(); ++iStart)
       {
-         return bisect(aLS, tMidPoint, b, y, tol);
+         iStart = std::search(iStart, aSource.end(), aName.begin(), aName.end(), tSameLetter);
+         if (iStart == aSource.end())
+         {
+            break;
+         }
+         auto iEnd = iStart + aName.size();
+         if ((iStart != aSource.begin() && tIsWord(*(iStart - 1))) || (iEnd != aSource.end() && tIsWord(*iEnd)))
+         {
+            continue;
+         }
+         while (iEnd != aSource.end() && std::isspace(static_cast<unsigned char>(*iEnd)))
+         {
+            ++iEnd;
+         }
+         if (iEnd != aSource.end() && *iEnd == '(')
+         {
+            return true;
+         }
       }
+      return false;
    }
 
    //-----------------------------------------------------------------------
 
-   /*
-    *  Convert an integer to binary representation to determine which phase to draw
+   /**
+    * Binds the unknown symbols exprtk meets to placeholders, so the expression can be checked before any of them
+    * is registered as a parameter
     */
-   Bitset int_to_bitset(uint aValue, int bits = MAX_GEOMETRIES)
+   struct ParameterResolver : exprtk::parser<double>::unknown_symbol_resolver
    {
-      if (bits <= 0)
-         return {};
-
-      Bitset tBinary(bits, 0);
-      // Fill MSB-first: tBinary[0] = bit (bits-1)
-      for (int i = 0; i < bits; ++i)
+      ParameterResolver()
+          : exprtk::parser<double>::unknown_symbol_resolver(e_usrmode_extended)
       {
-         int pos = bits - 1 - i;
-         tBinary[i] = static_cast<int>((aValue >> pos) & 1u);
       }
-      return tBinary;
-   }
-
-   //-----------------------------------------------------------------------
 
-   /**
-    * Convert a bitset to its integer representation
-    */
-   uint bitset_to_int(Bitset aBitset)
-   {
-      uint tValue = 0;
-      int tNumBits = static_cast<int>(aBitset.size());
-      for (int iBit = 0; iBit < tNumBits; iBit++)
+      bool process(const std::string &aSymbol, exprtk::symbol_table<double> &aSymbolTable, std::string &) override
       {
-         int pos = tNumBits - 1 - iBit;
-         tValue += aBitset[iBit] << pos;
+         mNames.push_back(aSymbol);
+         mPlaceholders.push_back(1.0);
+         return aSymbolTable.add_variable(aSymbol, mPlaceholders.back());
       }
-      return tValue;
-   }
+
+      std::vector<std::string> mNames;  // Unknown symbols in the order the parser met them
+      std::deque<double> mPlaceholders; // Values the unknown symbols are bound to while parsing
+   };
 
    //-----------------------------------------------------------------------
 
-   /*
-    * Gets the indices of the phase table that correspond to a given phase
+   /**
+    * Private evaluation state for a level-set function. Owns its own coordinates, symbol table and a compiled copy
+    * of the expression, so any number of contexts can evaluate the same level-set at the same time without locks
     */
-   std::vector<int> get_indices_for_phase(int aPhase)
+   class LSContext
    {
-      std::vector<int> indices;
-      for (size_t i = 0; i < gPhaseTable.size(); i++)
+    public:
+      explicit LSContext(const std::string &aSource)
       {
-         if (gPhaseTable[i] == aPhase)
+         // Bind the expression variables to the coordinates owned by this context
+         mSymbolTable.add_variable("x", mX);
+         mSymbolTable.add_variable("y", mY);
+         mSymbolTable.add_variable("z", mZ);
+         mSymbolTable.add_constants();
          {
-            indices.push_back(i);
+            // Input threads may be registering a parameter at the same time
+            std::lock_guard<std::mutex> lock(gParameterMutex);
+            for (uint iParameter = 0; iParameter < gNumParameters; iParameter++)
+            {
+               mSymbolTable.add_variable(gParameterNames[iParameter], gParameterValues[iParameter]);
+            }
+         }
+         mExpression.register_symbol_table(mSymbolTable);
+
+         // Unknown symbols are parsed as placeholders, then one may become a new parameter and the expression is
+         // compiled again against it
+         ParameterResolver tResolver;
+         exprtk::parser<double> tParser;
+         tParser.enable_unknown_symbol_resolver(&tResolver);
+         tParser.dec().collect_variables() = true;
+         if (!tParser.compile(aSource, mExpression))
+         {
+            throw std::invalid_argument("Failed to parse " + aSource + ": " + tParser.error());
+         }
+         if (!tResolver.mNames.empty())
+         {
+            mExpression.release();
+            bind_new_parameters(aSource, tResolver.mNames);
+            tParser.disable_unknown_symbol_resolver();
+            if (!tParser.compile(aSource, mExpression))
+            {
+               throw std::invalid_argument("Failed to parse " + aSource + ": " + tParser.error());
+            }
+         }
+
+         std::vector<std::pair<std::string, exprtk::parser<double>::symbol_type>> tSymbols;
+         tParser.dec().symbols(tSymbols);
+         std::lock_guard<std::mutex> lock(gParameterMutex);
+         for (const auto &[tName, tType] : tSymbols)
+         {
+            uint tIndex = find_parameter(tName);
+            if (tIndex != MORIS_UINT_MAX)
+            {
+               mParameters.push_back(tIndex);
+            }
          }
       }
-      return indices;
-   }
 
-   //-----------------------------------------------------------------------
+      // The symbol table refers to the members, so a context can't be copied or moved
+      LSContext(const LSContext &) = delete;
+      LSContext &operator=(const LSContext &) = delete;
 
-   /**
-    * Resets all active geometry phases to NONE
-    */
-   void reset_active_phases()
-   {
-      for (uint iG = 0; iG < MAX_GEOMETRIES; iG++)
+      // Indices of the parameters the expression uses
+      const std::vector<uint> &parameters() const
       {
-         gGeomsPhaseToPlot[iG] = PHASE::NONE;
+         return mParameters;
       }
-   }
 
-   //-----------------------------------------------------------------------
+      double eval(double aX, double aY, double aZ)
+      {
+         mX = aX;
+         mY = aY;
+         mZ = aZ;
+         return mExpression.value();
+      }
 
-   /**
-    * Adds geometry phases to plot from binary representation
-    * If bit is 1, plot positive phase; if bit is 0, plot negative phase
-    * Ex. If positive phase is already active but the binary indicates negative phase, it will then plot both pos and neg phases
-    */
-   void append_active_phases_from_bitset(const Bitset &aBinary)
-   {
-      for (uint iG = 0; iG < MAX_GEOMETRIES; iG++)
+      /**
+       * Evaluates the expression at aCount points given as coordinate arrays
+       */
+      void eval_batch(const double *aX, const double *aY, const double *aZ, double *aPhi, size_t aCount)
       {
-         if (aBinary[iG] == 1)
+         for (size_t iP = 0; iP < aCount; iP++)
          {
-            // Set to plot positive phase
-            if (gGeomsPhaseToPlot[iG] == PHASE::NONE)
+            mX = aX[iP];
+            mY = aY[iP];
+            mZ = aZ[iP];
+            aPhi[iP] = mExpression.value();
+         }
+      }
+
+      /**
+       * Evaluates the expression on the tensor grid aXs x aYs at a fixed z, aPhi is indexed [x][y]
+       */
+      void eval_grid(const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ, double *aPhi)
+      {
+         mZ = aZ;
+         for (size_t iX = 0; iX < aNumX; iX++)
+         {
+            mX = aXs[iX];
+            double *tRow = aPhi + iX * aNumY;
+            for (size_t iY = 0; iY < aNumY; iY++)
             {
-               gGeomsPhaseToPlot[iG] = PHASE::POSITIVE;
+               mY = aYs[iY];
+               tRow[iY] = mExpression.value();
             }
-            else if (gGeomsPhaseToPlot[iG] == PHASE::NEGATIVE)
+         }
+      }
+
+    private:
+      /**
+       * Registers the unknown symbols of an expression as parameters and binds them in place of their placeholders.
+       * Symbols another thread registered meanwhile are only bound. Throws if there is more than one new name, if the
+       * new name is called like a function or if there is no room for it
+       */
+      void bind_new_parameters(const std::string &aSource, const std::vector<std::string> &aNames)
+      {
+         std::vector<std::string> tNew;
+         {
+            std::lock_guard<std::mutex> lock(gParameterMutex);
+            for (const std::string &tName : aNames)
             {
-               gGeomsPhaseToPlot[iG] = PHASE::ALL;
+               if (find_parameter(tName) == MORIS_UINT_MAX)
+               {
+                  tNew.push_back(tName);
+               }
             }
          }
-         else
+
+         auto tList = [&tNew]()
          {
-            // Set to plot negative phase
-            if (gGeomsPhaseToPlot[iG] == PHASE::NONE)
+            std::string tText;
+            for (const std::string &tName : tNew)
             {
-               gGeomsPhaseToPlot[iG] = PHASE::NEGATIVE;
+               tText += (tText.empty() ? "" : ", ") + tName;
             }
-            else if (gGeomsPhaseToPlot[iG] == PHASE::POSITIVE)
+            return tText;
+         };
+         if (tNew.size() > 1)
+         {
+            throw std::invalid_argument("Unknown names " + tList() + " in " + aSource +
+                                        ": an expression can introduce one new parameter, set the others with k first");
+         }
+         if (tNew.size() == 1 && called_as_function(aSource, tNew[0]))
+         {
+            throw std::invalid_argument("Unknown function " + tNew[0] + " in " + aSource);
+         }
+
+         for (const std::string &tName : aNames)
+         {
+            uint tIndex = add_parameter(tName);
+            if (tIndex == MORIS_UINT_MAX)
             {
-               gGeomsPhaseToPlot[iG] = PHASE::ALL;
+               throw std::invalid_argument("No room for parameter " + tName + ", there are already " +
+                                           std::to_string(MAX_PARAMETERS));
             }
+            mSymbolTable.remove_variable(tName);
+            mSymbolTable.add_variable(tName, gParameterValues[tIndex]);
          }
       }
-   }
+
+      double mX = 0.0;
+      double mY = 0.0;
+      double mZ = 0.0;
+      std::vector<uint> mParameters;
+      exprtk::symbol_table<double> mSymbolTable;
+      exprtk::expression<double> mExpression;
+   };
 
    //-----------------------------------------------------------------------
 
    /**
-    * Gets all the bitsets from the phase table that are assigned to a given phase index,
-    * then sets the active geometry phases to plot accordingly
+    * Vector math for the level-set bytecode. Wraps AVX2 or SSE2 intrinsics, or plain doubles when neither is available
     */
-   void set_active_phases_from_phase_index(int aIndex)
+   namespace simd
    {
-      // Reset active phases
-      reset_active_phases();
-
-      // Get all the bitset indices for the given phase
-      std::vector<int> tIndices = get_indices_for_phase(aIndex);
+#if defined(__AVX2__)
+      using vec = __m256d;
+      using ivec = __m256i;
+      constexpr uint WIDTH = 4;
+
+      inline vec set1(double a) { return _mm256_set1_pd(a); }
+      inline vec load(const double *p) { return _mm256_loadu_pd(p); }
+      inline void store(double *p, vec a) { _mm256_storeu_pd(p, a); }
+      inline vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+      inline vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+      inline vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+      inline vec div(vec a, vec b) { return _mm256_div_pd(a, b); }
+      inline vec min(vec a, vec b) { return _mm256_min_pd(a, b); }
+      inline vec max(vec a, vec b) { return _mm256_max_pd(a, b); }
+      inline vec sqrt(vec a) { return _mm256_sqrt_pd(a); }
+      inline vec bit_and(vec a, vec b) { return _mm256_and_pd(a, b); }
+      inline vec bit_andnot(vec a, vec b) { return _mm256_andnot_pd(a, b); } // ~a & b
+      inline vec bit_or(vec a, vec b) { return _mm256_or_pd(a, b); }
+      inline vec bit_xor(vec a, vec b) { return _mm256_xor_pd(a, b); }
+      inline vec cmp_lt(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+      inline vec cmp_nan(vec a) { return _mm256_cmp_pd(a, a, _CMP_UNORD_Q); }
+      inline ivec as_ivec(vec a) { return _mm256_castpd_si256(a); }
+      inline vec as_vec(ivec a) { return _mm256_castsi256_pd(a); }
+      inline ivec iset1(long long a) { return _mm256_set1_epi64x(a); }
+      inline ivec iadd(ivec a, ivec b) { return _mm256_add_epi64(a, b); }
+      inline ivec isub(ivec a, ivec b) { return _mm256_sub_epi64(a, b); }
+      inline ivec iand(ivec a, ivec b) { return _mm256_and_si256(a, b); }
+      template <int N>
+      inline ivec ishl(ivec a) { return _mm256_slli_epi64(a, N); }
+#elif defined(__SSE2__)
+      using vec = __m128d;
+      using ivec = __m128i;
+      constexpr uint WIDTH = 2;
+
+      inline vec set1(double a) { return _mm_set1_pd(a); }
+      inline vec load(const double *p) { return _mm_loadu_pd(p); }
+      inline void store(double *p, vec a) { _mm_storeu_pd(p, a); }
+      inline vec add(vec a, vec b) { return _mm_add_pd(a, b); }
+      inline vec sub(vec a, vec b) { return _mm_sub_pd(a, b); }
+      inline vec mul(vec a, vec b) { return _mm_mul_pd(a, b); }
+      inline vec div(vec a, vec b) { return _mm_div_pd(a, b); }
+      inline vec min(vec a, vec b) { return _mm_min_pd(a, b); }
+      inline vec max(vec a, vec b) { return _mm_max_pd(a, b); }
+      inline vec sqrt(vec a) { return _mm_sqrt_pd(a); }
+      inline vec bit_and(vec a, vec b) { return _mm_and_pd(a, b); }
+      inline vec bit_andnot(vec a, vec b) { return _mm_andnot_pd(a, b); } // ~a & b
+      inline vec bit_or(vec a, vec b) { return _mm_or_pd(a, b); }
+      inline vec bit_xor(vec a, vec b) { return _mm_xor_pd(a, b); }
+      inline vec cmp_lt(vec a, vec b) { return _mm_cmplt_pd(a, b); }
+      inline vec cmp_nan(vec a) { return _mm_cmpunord_pd(a, a); }
+      inline ivec as_ivec(vec a) { return _mm_castpd_si128(a); }
+      inline vec as_vec(ivec a) { return _mm_castsi128_pd(a); }
+      inline ivec iset1(long long a) { return _mm_set1_epi64x(a); }
+      inline ivec iadd(ivec a, ivec b) { return _mm_add_epi64(a, b); }
+      inline ivec isub(ivec a, ivec b) { return _mm_sub_epi64(a, b); }
+      inline ivec iand(ivec a, ivec b) { return _mm_and_si128(a, b); }
+      template <int N>
+      inline ivec ishl(ivec a) { return _mm_slli_epi64(a, N); }
+#else
+      using vec = double;
+      using ivec = long long;
+      constexpr uint WIDTH = 1;
 
-      // Loop through the bitsets and convert to binary to set active regions for each geometry
-      for (int iIndex : tIndices)
+      inline ivec as_ivec(vec a)
       {
-         Bitset tBinary = int_to_bitset(iIndex, gNumGeoms); // Get the geometry signs for this index
-
-         append_active_phases_from_bitset(tBinary); // Add them to the active phases
+         ivec b;
+         std::memcpy(&b, &a, sizeof(a));
+         return b;
       }
-   }
+      inline vec as_vec(ivec a)
+      {
+         vec b;
+         std::memcpy(&b, &a, sizeof(a));
+         return b;
+      }
+      inline vec set1(double a) { return a; }
+      inline vec load(const double *p) { return *p; }
+      inline void store(double *p, vec a) { *p = a; }
+      inline vec add(vec a, vec b) { return a + b; }
+      inline vec sub(vec a, vec b) { return a - b; }
+      inline vec mul(vec a, vec b) { return a * b; }
+      inline vec div(vec a, vec b) { return a / b; }
+      inline vec min(vec a, vec b) { return a < b ? a : b; }
+      inline vec max(vec a, vec b) { return a > b ? a : b; }
+      inline vec sqrt(vec a) { return std::sqrt(a); }
+      inline vec bit_and(vec a, vec b) { return as_vec(as_ivec(a) & as_ivec(b)); }
+      inline vec bit_andnot(vec a, vec b) { return as_vec(~as_ivec(a) & as_ivec(b)); } // ~a & b
+      inline vec bit_or(vec a, vec b) { return as_vec(as_ivec(a) | as_ivec(b)); }
+      inline vec bit_xor(vec a, vec b) { return as_vec(as_ivec(a) ^ as_ivec(b)); }
+      inline vec cmp_lt(vec a, vec b) { return as_vec(a < b ? -1LL : 0LL); }
+      inline vec cmp_nan(vec a) { return as_vec(a != a ? -1LL : 0LL); }
+      inline ivec iset1(long long a) { return a; }
+      inline ivec iadd(ivec a, ivec b) { return a + b; }
+      inline ivec isub(ivec a, ivec b) { return a - b; }
+      inline ivec iand(ivec a, ivec b) { return a & b; }
+      template <int N>
+      inline ivec ishl(ivec a) { return (long long)((unsigned long long)a << N); }
+#endif
 
-   //-----------------------------------------------------------------------
+      // Picks b where the mask is set, a elsewhere
+      inline vec select(vec aMask, vec a, vec b) { return bit_or(bit_and(aMask, b), bit_andnot(aMask, a)); }
 
-   /**
-    * Function to see the negative region for all currently active geometries
-    */
-   void set_all_active_phases_to_negative()
-   {
-      for (uint iG = 0; iG < MAX_GEOMETRIES; iG++)
+      inline vec neg(vec a) { return bit_xor(set1(-0.0), a); }
+      inline vec abs(vec a) { return bit_andnot(set1(-0.0), a); }
+
+      // Adding and subtracting 1.5*2^52 rounds to the nearest integer for |a| < 2^51,
+      // the integer itself is left in the low bits of the sum
+      const double ROUND_MAGIC = 6755399441055744.0;
+
+      /**
+       * sin(a), or cos(a) when aCos is set. Cody-Waite reduction by pi/2 and the fdlibm kernel polynomials,
+       * accurate to a few ulp for |a| < 1e6
+       */
+      inline vec sin_cos(vec a, bool aCos)
       {
-         if (gGeomsPhaseToPlot[iG] != PHASE::NONE)
+         vec tSum = add(mul(a, set1(0.63661977236758134308)), set1(ROUND_MAGIC));
+         vec tQuadrant = sub(tSum, set1(ROUND_MAGIC));
+         ivec tQ = isub(as_ivec(tSum), as_ivec(set1(ROUND_MAGIC)));
+         if (aCos)
          {
-            gGeomsPhaseToPlot[iG] = PHASE::NEGATIVE;
+            tQ = iadd(tQ, iset1(1));
          }
+
+         // r = a - q*pi/2 in three parts
+         vec r = sub(a, mul(tQuadrant, set1(1.57079632673412561417e+00)));
+         r = sub(r, mul(tQuadrant, set1(6.07710050630396597660e-11)));
+         r = sub(r, mul(tQuadrant, set1(2.02226624879595063154e-21)));
+         vec z = mul(r, r);
+
+         vec tSin = set1(1.58969099521155010221e-10);
+         tSin = add(mul(tSin, z), set1(-2.50507602534068634195e-08));
+         tSin = add(mul(tSin, z), set1(2.75573137070700676789e-06));
+         tSin = add(mul(tSin, z), set1(-1.98412698298579493134e-04));
+         tSin = add(mul(tSin, z), set1(8.33333333332248946124e-03));
+         tSin = add(mul(tSin, z), set1(-1.66666666666666324348e-01));
+         tSin = add(r, mul(mul(r, z), tSin));
+
+         vec tCos = set1(-1.13596475577881948265e-11);
+         tCos = add(mul(tCos, z), set1(2.08757232129817482790e-09));
+         tCos = add(mul(tCos, z), set1(-2.75573143513906633035e-07));
+         tCos = add(mul(tCos, z), set1(2.48015872894767294178e-05));
+         tCos = add(mul(tCos, z), set1(-1.38888888888741095749e-03));
+         tCos = add(mul(tCos, z), set1(4.16666666666666019037e-02));
+         tCos = add(sub(set1(1.0), mul(set1(0.5), z)), mul(mul(z, z), tCos));
+
+         // Odd quadrants use the cosine kernel, quadrants 2 and 3 flip the sign
+         vec tSwap = as_vec(isub(iset1(0), iand(tQ, iset1(1))));
+         vec tSign = as_vec(ishl<62>(iand(tQ, iset1(2))));
+         return bit_xor(select(tSwap, tSin, tCos), tSign);
       }
-   }
+
+      /**
+       * exp(a) from a reduction by ln(2) and a degree 13 Taylor polynomial. Results below 1e-307 flush to zero
+       */
+      inline vec exp(vec a)
+      {
+         vec x = min(max(a, set1(-708.0)), set1(709.0));
+
+         vec tSum = add(mul(x, set1(1.44269504088896340736)), set1(ROUND_MAGIC));
+         vec k = sub(tSum, set1(ROUND_MAGIC));
+         ivec tK = isub(as_ivec(tSum), as_ivec(set1(ROUND_MAGIC)));
+
+         vec r = sub(x, mul(k, set1(6.93147180369123816490e-01)));
+         r = sub(r, mul(k, set1(1.90821492927058770002e-10)));
+
+         vec p = set1(1.0 / 6227020800.0);
+         p = add(mul(p, r), set1(1.0 / 479001600.0));
+         p = add(mul(p, r), set1(1.0 / 39916800.0));
+         p = add(mul(p, r), set1(1.0 / 3628800.0));
+         p = add(mul(p, r), set1(1.0 / 362880.0));
+         p = add(mul(p, r), set1(1.0 / 40320.0));
+         p = add(mul(p, r), set1(1.0 / 5040.0));
+         p = add(mul(p, r), set1(1.0 / 720.0));
+         p = add(mul(p, r), set1(1.0 / 120.0));
+         p = add(mul(p, r), set1(1.0 / 24.0));
+         p = add(mul(p, r), set1(1.0 / 6.0));
+         p = add(mul(p, r), set1(0.5));
+         p = add(mul(p, r), set1(1.0));
+         p = add(mul(p, r), set1(1.0));
+
+         // Scale by 2^k through the exponent bits
+         vec tScale = as_vec(ishl<52>(iadd(tK, iset1(1023))));
+         vec tResult = mul(p, tScale);
+
+         tResult = select(cmp_lt(set1(709.782712893384), a), tResult, set1(std::numeric_limits<double>::infinity()));
+         tResult = select(cmp_lt(a, set1(-708.0)), tResult, set1(0.0));
+         return select(cmp_nan(a), tResult, a);
+      }
+   } // namespace simd
 
    //-----------------------------------------------------------------------
 
    /**
-    * Function to see the positive region for all currently active geometries
+    * Operations of the level-set bytecode
     */
-   void set_all_active_phases_to_positive()
+   enum class OPCODE : unsigned char
    {
-      for (uint iG = 0; iG < MAX_GEOMETRIES; iG++)
-      {
-         if (gGeomsPhaseToPlot[iG] != PHASE::NONE)
-         {
-            gGeomsPhaseToPlot[iG] = PHASE::POSITIVE;
-         }
-      }
-   }
-
-   //-----------------------------------------------------------------------
+      X,
+      Y,
+      Z,
+      CONST,
+      PARAM,
+      NEG,
+      ADD,
+      SUB,
+      MUL,
+      DIV,
+      POW,
+      MIN,
+      MAX,
+      ABS,
+      SQRT,
+      SIN,
+      COS,
+      TAN,
+      EXP
+   };
 
-   /*
-    *  Draw vertex in polar coordinates with normal
+   /**
+    * One bytecode instruction. Every instruction writes its own register (the program is in SSA form),
+    * registers 0, 1 and 2 hold x, y and z
     */
-   static void Vertex(double th, double ph)
+   struct Instruction
    {
-      double x = Sin(th) * Cos(ph);
-      double y = Cos(th) * Cos(ph);
-      double z = Sin(ph);
-      //  For a sphere at the origin, the position
-      //  and normal vectors are the same
-      glNormal3d(x, y, z);
-      glVertex3d(x, y, z);
+      OPCODE mOp;
+      uint mA = 0;        // First operand register, or the parameter index of a PARAM instruction
+      uint mB = 0;        // Second operand register
+      double mValue = 0.0; // Value of a CONST instruction
+   };
+
+   // Operations that only use their first operand
+   inline bool is_unary(OPCODE aOp)
+   {
+      return aOp == OPCODE::NEG || aOp == OPCODE::ABS || aOp == OPCODE::SQRT || aOp == OPCODE::SIN ||
+             aOp == OPCODE::COS || aOp == OPCODE::TAN || aOp == OPCODE::EXP;
    }
 
    //-----------------------------------------------------------------------
 
-   /*
-    *  Draw a ball
-    *     at (x,y,z)
-    *     radius (r)
+   /**
+    * Applies an operation to scalar operands, used for constant folding and lanes without a vector kernel
     */
-   static void ball(double x, double y, double z, double r)
+   double apply_op(OPCODE aOp, double a, double b)
    {
-      //  Save transformation
-      glPushMatrix();
-      //  Offset, scale and rotate
-      glTranslated(x, y, z);
-      glScaled(r, r, r);
-      //  White ball with yellow specular
-      float yellow[] = {1.0, 1.0, 0.0, 1.0};
-      float Emission[] = {0.0, 0.0, (float)0.01 * gEmission, 1.0};
-      glColor3f(1, 1, 1);
-      glMaterialf(GL_FRONT, GL_SHININESS, gShiny);
-      glMaterialfv(GL_FRONT, GL_SPECULAR, yellow);
-      glMaterialfv(GL_FRONT, GL_EMISSION, Emission);
-      //  Bands of latitude
-      for (int ph = -90; ph < 90; ph += gBallIncrement)
+      switch (aOp)
       {
-         glBegin(GL_QUAD_STRIP);
-         for (int th = 0; th <= 360; th += 2 * gBallIncrement)
-         {
-            Vertex(th, ph);
-            Vertex(th, ph + gBallIncrement);
-         }
-         glEnd();
+      case OPCODE::NEG:
+         return -a;
+      case OPCODE::ADD:
+         return a + b;
+      case OPCODE::SUB:
+         return a - b;
+      case OPCODE::MUL:
+         return a * b;
+      case OPCODE::DIV:
+         return a / b;
+      case OPCODE::POW:
+         return std::pow(a, b);
+      case OPCODE::MIN:
+         return a < b ? a : b;
+      case OPCODE::MAX:
+         return a > b ? a : b;
+      case OPCODE::ABS:
+         return std::abs(a);
+      case OPCODE::SQRT:
+         return std::sqrt(a);
+      case OPCODE::SIN:
+         return std::sin(a);
+      case OPCODE::COS:
+         return std::cos(a);
+      case OPCODE::TAN:
+         return std::tan(a);
+      case OPCODE::EXP:
+         return std::exp(a);
+      default:
+         return std::numeric_limits<double>::quiet_NaN();
       }
-      //  Undo transofrmations
-      glPopMatrix();
    }
 
    //-----------------------------------------------------------------------
 
-   // Helper to trim whitespace from start and end of a string
-   std::string trim(const std::string &s)
+   /**
+    * Closed interval of values. An interval containing NaN is replaced by the whole real line
+    */
+   struct Interval
    {
-      size_t start = s.find_first_not_of(" \t\n\r");
-      if (start == std::string::npos)
-         return "";
-      size_t end = s.find_last_not_of(" \t\n\r");
-      return s.substr(start, end - start + 1);
-   }
+      double mLower;
+      double mUpper;
+   };
 
-   //-----------------------------------------------------------------------
+   // sin over an interval, given the offset of its maxima from 0 (cos is sin with its maxima at 0 instead of pi/2)
+   Interval periodic_interval(const Interval &a, double aMaxAt, double (*aFunction)(double))
+   {
+      const double tTwoPi = 2.0 * M_PI;
+      if (a.mUpper - a.mLower >= tTwoPi)
+      {
+         return {-1.0, 1.0};
+      }
+
+      double tLow = aFunction(a.mLower);
+      double tHigh = aFunction(a.mUpper);
+      Interval tResult = {std::min(tLow, tHigh), std::max(tLow, tHigh)};
+
+      // Extrema inside the interval
+      double tMax = aMaxAt + tTwoPi * std::ceil((a.mLower - aMaxAt) / tTwoPi);
+      if (tMax <= a.mUpper)
+      {
+         tResult.mUpper = 1.0;
+      }
+      double tMin = aMaxAt + M_PI + tTwoPi * std::ceil((a.mLower - aMaxAt - M_PI) / tTwoPi);
+      if (tMin <= a.mUpper)
+      {
+         tResult.mLower = -1.0;
+      }
+      return tResult;
+   }
 
    /**
-    * Gets an entire phase table from user input
+    * Bounds an operation over intervals of its operands. aSame marks both operands as the same value, so x*x stays non-negative.
+    * Results are widened slightly to cover rounding, and become the whole real line wherever the operation may be undefined
     */
-   void get_phase_table_user_input()
+   Interval apply_interval(OPCODE aOp, const Interval &a, const Interval &b, bool aSame)
    {
-      // Read a full line from console
-      std::string tInput;
-      std::cout << "Enter phase numbers for each geometry (comma or space separated): ";
-      std::getline(std::cin, tInput);
+      const double tInf = std::numeric_limits<double>::infinity();
+      const Interval tAll = {-tInf, tInf};
 
-      // Normalize delimiters: replace commas with spaces so we can use >> extraction
-      for (char &c : tInput)
+      auto tHull = [](std::initializer_list<double> aValues)
       {
-         if (c == ',')
-            c = ' ';
-      }
-
-      // Parse into a local temporary table to avoid holding the mutex during I/O
-      std::stringstream ss(tInput);
-      std::string token;
-      size_t tPhase = 0;
-      std::vector<int> tTemp(gPhaseTable.size(), -1);
+         return Interval{std::min(aValues), std::max(aValues)};
+      };
 
-      while (ss >> token)
+      Interval tResult = tAll;
+      switch (aOp)
       {
-         token = trim(token); // remove surrounding whitespace
-         if (token.empty())
-            continue;
-         if (tPhase >= tTemp.size())
-            break; // ignore extra values
-         try
+      case OPCODE::NEG:
+         tResult = {-a.mUpper, -a.mLower};
+         break;
+      case OPCODE::ADD:
+         tResult = {a.mLower + b.mLower, a.mUpper + b.mUpper};
+         break;
+      case OPCODE::SUB:
+         tResult = {a.mLower - b.mUpper, a.mUpper - b.mLower};
+         break;
+      case OPCODE::MUL:
+         if (aSame)
          {
-            tTemp[tPhase] = static_cast<int>(std::stoul(token));
+            double tLow = a.mLower * a.mLower;
+            double tHigh = a.mUpper * a.mUpper;
+            tResult = a.mLower >= 0 ? Interval{tLow, tHigh} : a.mUpper <= 0 ? Interval{tHigh, tLow} : Interval{0.0, std::max(tLow, tHigh)};
          }
-         catch (const std::exception &)
+         else
          {
-            // Invalid token: leave as invalid phase and continue
-            tTemp[tPhase] = -1;
+            tResult = tHull({a.mLower * b.mLower, a.mLower * b.mUpper, a.mUpper * b.mLower, a.mUpper * b.mUpper});
          }
-         ++tPhase;
+         break;
+      case OPCODE::DIV:
+         if (b.mLower > 0 || b.mUpper < 0)
+         {
+            tResult = tHull({a.mLower / b.mLower, a.mLower / b.mUpper, a.mUpper / b.mLower, a.mUpper / b.mUpper});
+         }
+         break;
+      case OPCODE::POW:
+         // Monotonic in both operands for a positive base, so the corners bound it
+         if (a.mLower > 0)
+         {
+            tResult = tHull({std::pow(a.mLower, b.mLower), std::pow(a.mLower, b.mUpper), std::pow(a.mUpper, b.mLower), std::pow(a.mUpper, b.mUpper)});
+         }
+         break;
+      case OPCODE::MIN:
+         tResult = {std::min(a.mLower, b.mLower), std::min(a.mUpper, b.mUpper)};
+         break;
+      case OPCODE::MAX:
+         tResult = {std::max(a.mLower, b.mLower), std::max(a.mUpper, b.mUpper)};
+         break;
+      case OPCODE::ABS:
+         tResult = a.mLower >= 0 ? a : a.mUpper <= 0 ? Interval{-a.mUpper, -a.mLower} : Interval{0.0, std::max(-a.mLower, a.mUpper)};
+         break;
+      case OPCODE::SQRT:
+         if (a.mLower >= 0)
+         {
+            tResult = {std::sqrt(a.mLower), std::sqrt(a.mUpper)};
+         }
+         break;
+      case OPCODE::SIN:
+         tResult = periodic_interval(a, 0.5 * M_PI, std::sin);
+         break;
+      case OPCODE::COS:
+         tResult = periodic_interval(a, 0.0, std::cos);
+         break;
+      case OPCODE::TAN:
+      {
+         // Monotonic between poles
+         double tPole = 0.5 * M_PI + M_PI * std::ceil((a.mLower - 0.5 * M_PI) / M_PI);
+         if (tPole > a.mUpper && a.mUpper - a.mLower < M_PI)
+         {
+            tResult = {std::tan(a.mLower), std::tan(a.mUpper)};
+         }
+         break;
+      }
+      case OPCODE::EXP:
+         tResult = {std::exp(a.mLower), std::exp(a.mUpper)};
+         break;
+      default:
+         break;
       }
 
-      // Expected number of phases depends on number of geometries
-      size_t tExpected = (gNumGeoms >= 0 && gNumGeoms < (8 * sizeof(uint))) ? (1u << gNumGeoms) : 0u;
-
-      if (tPhase != tExpected)
+      if (std::isnan(tResult.mLower) || std::isnan(tResult.mUpper))
       {
-         std::cout << "Incorrect number of phases entered. Expected " << tExpected << " but got " << tPhase << ". Try again\n";
-         get_phase_table_user_input();
-         return;
+         return tAll;
       }
 
-      // Commit the parsed values into the shared phase table under the mutex
+      // Widen outward for the rounding of the point evaluation, which scales with the operands rather than the result,
+      // so an ADD or SUB that cancels to nearly zero doesn't keep a sign the point evaluation may not have
+      auto tMagnitude = [](const Interval &aInterval)
       {
-         std::lock_guard<std::mutex> lock(gPhaseTableMutex);
-         // Reset to -1 first, then copy parsed values
-         std::fill(gPhaseTable.begin(), gPhaseTable.end(), -1);
-         for (size_t i = 0; i < tTemp.size(); ++i)
-         {
-            gPhaseTable[i] = tTemp[i];
-         }
-
-         // Plot all phases in the projection
-         uint tMaxPhase = *std::max_element(gPhaseTable.begin(), gPhaseTable.end());
-         gPhasesToPlot.resize(tMaxPhase + 1);
-         std::iota(gPhasesToPlot.begin(), gPhasesToPlot.end(), 0);
-      }
+         return std::max(std::abs(aInterval.mLower), std::abs(aInterval.mUpper));
+      };
+      const double tSlack = 1e-14;
+      double tScale = std::max(tMagnitude(a), tMagnitude(tResult)) + (is_unary(aOp) ? 0.0 : tMagnitude(b));
+      tResult.mLower = std::nextafter(tResult.mLower - tScale * tSlack, -tInf);
+      tResult.mUpper = std::nextafter(tResult.mUpper + tScale * tSlack, tInf);
+      return tResult;
    }
 
    //-----------------------------------------------------------------------
 
    /**
-    * Uses exprtk to parse a level-set function from a string.
-    * @param aInput String containing the level-set function expression (must be of x,y,z)
+    * Builds level-set bytecode. Constant operands are folded and identical instructions are shared
     */
-   LS load_LS_from_string(std::string aInput)
+   class CodeBuilder
    {
-      // Define LS variables, add them to exprtk symbol table
-      exprtk::symbol_table<double> tSymbolTable;
-      tSymbolTable.add_variable("x", gX);
-      tSymbolTable.add_variable("y", gY);
-      tSymbolTable.add_variable("z", gZ);
-      tSymbolTable.add_constants();
+    public:
+      CodeBuilder()
+      {
+         mCode = {{OPCODE::X}, {OPCODE::Y}, {OPCODE::Z}};
+      }
 
-      // Create expression
-      exprtk::expression<double> tExpression;
-      tExpression.register_symbol_table(tSymbolTable);
+      const std::vector<Instruction> &code() const
+      {
+         return mCode;
+      }
 
-      // Parse the user input
-      exprtk::parser<double> tParser;
-      if (!tParser.compile(aInput, tExpression))
+      bool is_const(uint aReg) const
       {
-         Fatal("Error: Failed to parse expression: %s", aInput.c_str());
+         return mCode[aReg].mOp == OPCODE::CONST;
       }
 
-      return tExpression;
-   }
+      uint constant(double aValue)
+      {
+         return add({OPCODE::CONST, 0, 0, aValue});
+      }
 
-   //-----------------------------------------------------------------------
+      uint parameter(uint aIndex)
+      {
+         return add({OPCODE::PARAM, aIndex, 0, 0.0});
+      }
 
-   /**
-    * Gets level-set function input from the user without blocking the main thread.
-    *
-    * @param aGeometryIndex Index of the geometry to update
-    */
-   void request_LS_input_async(uint aGeometryIndex)
-   {
-      // Detach thread: it owns its lifetime and will signal redisplay on completion.
-      std::thread([aGeometryIndex]()
-                  {
-        std::string tInput;
-        std::cout << ("Enter a level-set function of (x,y,z):");
-        if (!std::getline(std::cin, tInput))
-        {
-           std::cerr << "Input aborted or EOF encountered.\n";
-           return;
-        }
+      /**
+       * Emits an operation and returns the register holding its result
+       */
+      uint emit(OPCODE aOp, uint a, uint b = 0)
+      {
+         bool tUnary = is_unary(aOp);
+         if (is_const(a) && (tUnary || is_const(b)))
+         {
+            return constant(apply_op(aOp, mCode[a].mValue, tUnary ? 0.0 : mCode[b].mValue));
+         }
+         return add({aOp, a, tUnary ? 0 : b, 0.0});
+      }
 
-        tInput = trim(tInput);
-        if (tInput.empty())
-        {
-           std::cerr << "Empty input - ignoring.\n";
-           return;
-        }
+      /**
+       * Parses an expression into the builder.
+       * Returns false for anything outside the supported subset, which is then left to exprtk
+       */
+      bool parse(const std::string &aSource, uint &aResult)
+      {
+         mSource = aSource;
+         mPos = 0;
+         mOk = true;
 
-        try
-        {
-           // Parse and compile expression (keeps same semantics as synchronous helper)
-           LS tExpr = load_LS_from_string(tInput);
+         aResult = parse_sum();
+         skip_space();
+         return mOk && mPos == mSource.size();
+      }
 
-           // Commit into shared state
-           {
-              std::lock_guard<std::mutex> lock(gLevelSetMutex);
-              if (aGeometryIndex < gLevelSets.size())
-              {
-                 gLevelSets[aGeometryIndex] = tExpr;
-                 gGeomsPhaseToPlot[aGeometryIndex] = PHASE::ALL;
-              }
-           }
-        }
-        catch (const std::exception &)
-        {
-           // load_LS_from_string may call Fatal on parse failure; catch any exceptions just in case.
-           std::cerr << "Failed to parse level-set expression.\n";
-        } })
-          .detach();
-   }
+    private:
+      uint add(const Instruction &aInstruction)
+      {
+         // Share identical instructions
+         std::string tKey(reinterpret_cast<const char *>(&aInstruction.mOp), sizeof(aInstruction.mOp));
+         tKey.append(reinterpret_cast<const char *>(&aInstruction.mA), sizeof(aInstruction.mA));
+         tKey.append(reinterpret_cast<const char *>(&aInstruction.mB), sizeof(aInstruction.mB));
+         tKey.append(reinterpret_cast<const char *>(&aInstruction.mValue), sizeof(aInstruction.mValue));
+
+         auto tFound = mShared.find(tKey);
+         if (tFound != mShared.end())
+         {
+            return tFound->second;
+         }
 
-   //-----------------------------------------------------------------------
+         mCode.push_back(aInstruction);
+         mShared[tKey] = mCode.size() - 1;
+         return mCode.size() - 1;
+      }
 
-   /**
-    * Prompts the user to enter a phase index for a given bitset and updates the phase table accordingly.
-    *
-    * @param aPhaseIdx Index in the phase table to update
-    * @param aBitset Bitset representing the geometry signs for this phase
-    */
-   void prompt_and_update_phase(uint aPhaseIdx, Bitset aBitset)
-   {
-      // Print prompt showing bitset as +/-
-      std::cout << "Enter a phase for the current bitset (";
-      for (size_t i = 0; i < aBitset.size(); ++i)
+      void skip_space()
       {
-         std::cout << (aBitset[i] == 1 ? "+" : "-");
-         if (i + 1 < aBitset.size())
-            std::cout << ",";
+         while (mPos < mSource.size() && std::isspace(static_cast<unsigned char>(mSource[mPos])))
+         {
+            mPos++;
+         }
       }
-      std::cout << "): ";
-
-      // Read input
-      std::string tInput;
-      std::getline(std::cin, tInput);
 
-      // Convert string input to integer if valid
-      int tPhaseValue = 0;
-      try
+      // Consumes aChar if it is the next non-space character
+      bool accept(char aChar)
       {
-         tInput = trim(tInput);
-         if (!tInput.empty())
-            tPhaseValue = std::stoi(tInput);
+         skip_space();
+         if (mPos < mSource.size() && mSource[mPos] == aChar)
+         {
+            mPos++;
+            return true;
+         }
+         return false;
       }
-      catch (const std::exception &)
+
+      uint fail()
       {
-         std::cerr << "Invalid phase input - ignoring.\n";
-         return;
+         mOk = false;
+         mPos = mSource.size();
+         return 0;
       }
 
-      // Update shared phase table
+      // sum := product (('+' | '-') product)*
+      uint parse_sum()
       {
-         std::lock_guard<std::mutex> lock(gPhaseTableMutex);
-         // check that the given phase index is appropriate for the number of geometries
-         if (tPhaseValue > 0 and tPhaseValue < (1 << gNumGeoms) - 1)
+         uint tResult = parse_product();
+         while (mOk)
          {
+            if (accept('+'))
+               tResult = emit(OPCODE::ADD, tResult, parse_product());
+            else if (accept('-'))
+               tResult = emit(OPCODE::SUB, tResult, parse_product());
+            else
+               break;
+         }
+         return tResult;
+      }
+
+      // product := unary (('*' | '/') unary)*
+      uint parse_product()
+      {
+         uint tResult = parse_unary();
+         while (mOk)
+         {
+            if (accept('*'))
+               tResult = emit(OPCODE::MUL, tResult, parse_unary());
+            else if (accept('/'))
+               tResult = emit(OPCODE::DIV, tResult, parse_unary());
+            else
+               break;
+         }
+         return tResult;
+      }
+
+      // unary := ('-' | '+') unary | power. Unary minus binds weaker than '^', as in exprtk
+      uint parse_unary()
+      {
+         if (accept('-'))
+            return emit(OPCODE::NEG, parse_unary());
+         if (accept('+'))
+            return parse_unary();
+         return parse_power();
+      }
+
+      // power := primary ('^' unary)?, which makes '^' right associative
+      uint parse_power()
+      {
+         uint tBase = parse_primary();
+         if (mOk && accept('^'))
+         {
+            return power(tBase, parse_unary());
+         }
+         return tBase;
+      }
+
+      // Small integer powers become multiplications
+      uint power(uint aBase, uint aExponent)
+      {
+         if (is_const(aExponent))
+         {
+            double tExponent = mCode[aExponent].mValue;
+            if (tExponent == std::floor(tExponent) && std::abs(tExponent) <= 64)
+            {
+               uint tPower = std::abs(tExponent);
+               if (tPower == 0)
+               {
+                  return constant(1.0);
+               }
+
+               // Binary exponentiation
+               uint tResult = 0;
+               bool tHaveResult = false;
+               uint tSquare = aBase;
+               while (tPower > 0)
+               {
+                  if (tPower & 1u)
+                  {
+                     tResult = tHaveResult ? emit(OPCODE::MUL, tResult, tSquare) : tSquare;
+                     tHaveResult = true;
+                  }
+                  tPower >>= 1;
+                  if (tPower > 0)
+                  {
+                     tSquare = emit(OPCODE::MUL, tSquare, tSquare);
+                  }
+               }
+               return tExponent < 0 ? emit(OPCODE::DIV, constant(1.0), tResult) : tResult;
+            }
+         }
+         return emit(OPCODE::POW, aBase, aExponent);
+      }
+
+      uint parse_primary()
+      {
+         skip_space();
+         if (mPos >= mSource.size())
+         {
+            return fail();
+         }
+
+         char tChar = mSource[mPos];
+
+         // Number
+         if (std::isdigit(static_cast<unsigned char>(tChar)) || tChar == '.')
+         {
+            const char *tBegin = mSource.c_str() + mPos;
+            char *tEnd = nullptr;
+            double tValue = std::strtod(tBegin, &tEnd);
+            if (tEnd == tBegin)
+            {
+               return fail();
+            }
+            mPos += tEnd - tBegin;
+            return constant(tValue);
+         }
+
+         // Parenthesized expression
+         if (accept('('))
+         {
+            uint tResult = parse_sum();
+            return accept(')') ? tResult : fail();
+         }
+
+         // Variable, constant or function call
+         if (!std::isalpha(static_cast<unsigned char>(tChar)))
+         {
+            return fail();
+         }
+         std::string tName;
+         while (mPos < mSource.size() && (std::isalnum(static_cast<unsigned char>(mSource[mPos])) || mSource[mPos] == '_'))
+         {
+            tName += std::tolower(static_cast<unsigned char>(mSource[mPos++]));
+         }
+
+         if (tName == "x")
+            return 0;
+         if (tName == "y")
+            return 1;
+         if (tName == "z")
+            return 2;
+         if (tName == "pi")
+            return constant(3.141592653589793238462643383279502);
+         if (tName == "epsilon")
+            return constant(std::numeric_limits<double>::epsilon());
+         if (tName == "inf")
+            return constant(std::numeric_limits<double>::infinity());
+
+         static const std::unordered_map<std::string, OPCODE> tFunctions = {
+             {"abs", OPCODE::ABS},
+             {"sqrt", OPCODE::SQRT},
+             {"sin", OPCODE::SIN},
+             {"cos", OPCODE::COS},
+             {"tan", OPCODE::TAN},
+             {"exp", OPCODE::EXP},
+             {"min", OPCODE::MIN},
+             {"max", OPCODE::MAX},
+             {"pow", OPCODE::POW}};
+
+         auto tFunction = tFunctions.find(tName);
+         if (tFunction == tFunctions.end())
+         {
+            std::unique_lock<std::mutex> lock(gParameterMutex);
+            uint tParameter = find_parameter(tName);
+            lock.unlock();
+            return tParameter != MORIS_UINT_MAX ? parameter(tParameter) : fail();
+         }
+         if (!accept('('))
+         {
+            return fail();
+         }
+
+         // Arguments
+         std::vector<uint> tArgs = {parse_sum()};
+         while (mOk && accept(','))
+         {
+            tArgs.push_back(parse_sum());
+         }
+         if (!mOk || !accept(')'))
+         {
+            return fail();
+         }
+
+         OPCODE tOp = tFunction->second;
+         if (tOp == OPCODE::MIN || tOp == OPCODE::MAX)
+         {
+            // Variadic, folded left to right
+            uint tResult = tArgs[0];
+            for (size_t iArg = 1; iArg < tArgs.size(); iArg++)
+            {
+               tResult = emit(tOp, tResult, tArgs[iArg]);
+            }
+            return tResult;
+         }
+         if (tOp == OPCODE::POW)
+         {
+            return tArgs.size() == 2 ? power(tArgs[0], tArgs[1]) : fail();
+         }
+         return tArgs.size() == 1 ? emit(tOp, tArgs[0]) : fail();
+      }
+
+      std::vector<Instruction> mCode;
+      std::unordered_map<std::string, uint> mShared; // Register of every emitted instruction, keyed by its encoding
+      std::string mSource;
+      size_t mPos = 0;
+      bool mOk = true;
+   };
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Level-set expression lowered to register bytecode and executed on VM_BLOCK points per instruction with SIMD.
+    * Programs are immutable once compiled and can be shared between threads
+    */
+   class LSProgram
+   {
+    public:
+      /**
+       * Lowers an expression to bytecode, returns nullptr if it uses anything the bytecode doesn't support
+       */
+      static std::shared_ptr<const LSProgram> compile(const std::string &aSource)
+      {
+         CodeBuilder tBuilder;
+         uint tOutput;
+         if (!tBuilder.parse(aSource, tOutput))
+         {
+            return nullptr;
+         }
+
+         std::vector<uint> tDepends;
+         auto tProgram = build(tBuilder, {tOutput}, tDepends);
+
+         // Look for phi = f(x) + g(y) or phi = f(x) * g(y), z is fixed on a grid
+         const Instruction &tRoot = tBuilder.code()[tOutput];
+         tProgram->mProduct = tOutput >= 3 && (tRoot.mOp == OPCODE::MUL || tRoot.mOp == OPCODE::DIV);
+         tProgram->mSeparable = tProgram->split_terms(tBuilder.code(), tDepends, tOutput, false);
+         if (!tProgram->mSeparable)
+         {
+            tProgram->mRowTerms.clear();
+            tProgram->mColumnTerms.clear();
+         }
+         return tProgram;
+      }
+
+      /**
+       * Lowers several expressions to one program with an output per expression. Identical subexpressions of
+       * different expressions are shared, so they are evaluated once per point. Returns nullptr if any expression
+       * uses anything the bytecode doesn't support
+       */
+      static std::shared_ptr<const LSProgram> compile_scene(const std::vector<std::string> &aSources)
+      {
+         CodeBuilder tBuilder;
+         std::vector<uint> tOutputs(aSources.size());
+         for (size_t iSource = 0; iSource < aSources.size(); iSource++)
+         {
+            if (!tBuilder.parse(aSources[iSource], tOutputs[iSource]))
+            {
+               return nullptr;
+            }
+         }
+
+         std::vector<uint> tDepends;
+         return build(tBuilder, tOutputs, tDepends);
+      }
+
+      // Number of instructions evaluated for every point, not counting constants
+      size_t num_instructions() const
+      {
+         return mCode.size();
+      }
+
+      size_t num_outputs() const
+      {
+         return mOutputs.size();
+      }
+
+      // Whether grids are evaluated as an outer sum or product of row and column terms
+      bool separable() const
+      {
+         return mSeparable;
+      }
+
+      /**
+       * Bounds the program over a box of coordinates by interval arithmetic
+       */
+      Interval eval_interval(const Interval &aX, const Interval &aY, const Interval &aZ) const
+      {
+         thread_local std::vector<Interval> tRegs;
+         tRegs.resize(mNumRegisters);
+         tRegs[0] = aX;
+         tRegs[1] = aY;
+         tRegs[2] = aZ;
+         for_each_constant([](uint aReg, double aValue)
+                           { tRegs[aReg] = {aValue, aValue}; });
+         for (const auto &[tDst, tInstruction] : mCode)
+         {
+            tRegs[tDst] = apply_interval(tInstruction.mOp, tRegs[tInstruction.mA], tRegs[tInstruction.mB], tInstruction.mA == tInstruction.mB);
+         }
+         return tRegs[mOutput];
+      }
+
+      /**
+       * Evaluates the program at aCount points given as coordinate arrays
+       */
+      void eval_batch(const double *aX, const double *aY, const double *aZ, double *aPhi, size_t aCount) const
+      {
+         simd::vec *tRegs = registers();
+         for (size_t iP = 0; iP < aCount; iP += VM_BLOCK)
+         {
+            size_t tCount = std::min<size_t>(VM_BLOCK, aCount - iP);
+            load_block(tRegs, 0, aX + iP, tCount);
+            load_block(tRegs, 1, aY + iP, tCount);
+            load_block(tRegs, 2, aZ + iP, tCount);
+            run_block(tRegs, mCode);
+            store_block(tRegs, mOutput, aPhi + iP, tCount);
+         }
+      }
+
+      /**
+       * Evaluates the program on the tensor grid aXs x aYs at a fixed z, aPhi is indexed [x][y]
+       */
+      void eval_grid(const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ, double *aPhi) const
+      {
+         if (mSeparable)
+         {
+            eval_grid_separable(aXs, aNumX, aYs, aNumY, aZ, aPhi, nullptr, 0);
+            return;
+         }
+
+         eval_grid_blocks(aXs, aNumX, aYs, aNumY, aZ, &aPhi, nullptr, 0);
+      }
+
+      /**
+       * Evaluates every output of a scene program on the tensor grid aXs x aYs at a fixed z.
+       * aPhis holds an array indexed [x][y] per output
+       */
+      void eval_grid_outputs(const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ, double *const *aPhis) const
+      {
+         eval_grid_blocks(aXs, aNumX, aYs, aNumY, aZ, aPhis, nullptr, 0);
+      }
+
+      /**
+       * Evaluates every output of a scene program and its gradient on the tensor grid aXs x aYs at a fixed z.
+       * The gradients are laid out like those of eval_grid_gradient
+       */
+      void eval_grid_gradient_outputs(const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ,
+                                      double *const *aPhis, double *const *aGradients, size_t aGradientStride) const
+      {
+         eval_grid_blocks(aXs, aNumX, aYs, aNumY, aZ, aPhis, aGradients, aGradientStride);
+      }
+
+      /**
+       * Evaluates the program and its gradient at aCount points by forward-mode differentiation.
+       * aGradient receives the planes dphi/dx, dphi/dy and dphi/dz, aGradientStride apart
+       */
+      void eval_batch_gradient(const double *aX, const double *aY, const double *aZ, double *aPhi, double *aGradient,
+                               size_t aGradientStride, size_t aCount) const
+      {
+         simd::vec *tRegs = dual_registers();
+         for (size_t iP = 0; iP < aCount; iP += VM_BLOCK)
+         {
+            size_t tCount = std::min<size_t>(VM_BLOCK, aCount - iP);
+            load_block(tRegs, 0, aX + iP, tCount);
+            load_block(tRegs, DUAL, aY + iP, tCount);
+            load_block(tRegs, 2 * DUAL, aZ + iP, tCount);
+            run_block_dual(tRegs, mCode);
+            store_block_dual(tRegs, mOutput, aPhi + iP, aGradient + iP, aGradientStride, tCount);
+         }
+      }
+
+      /**
+       * Evaluates the program and its gradient on the tensor grid aXs x aYs at a fixed z.
+       * aPhi is indexed [x][y], aGradient holds the planes dphi/dx, dphi/dy and dphi/dz indexed the same way, aGradientStride apart
+       */
+      void eval_grid_gradient(const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ, double *aPhi, double *aGradient,
+                              size_t aGradientStride) const
+      {
+         if (mSeparable)
+         {
+            eval_grid_separable(aXs, aNumX, aYs, aNumY, aZ, aPhi, aGradient, aGradientStride);
+            return;
+         }
+
+         eval_grid_blocks(aXs, aNumX, aYs, aNumY, aZ, &aPhi, &aGradient, aGradientStride);
+      }
+
+#ifdef JIT
+      /**
+       * C++ source of a native kernel with the same code. Defines ls_grid and ls_batch with the
+       * signatures of eval_grid and eval_batch, loop invariant code is hoisted the same way
+       */
+      std::string native_source() const
+      {
+         std::ostringstream tSource;
+         tSource << "#include <math.h>\n"
+                    "#include <stddef.h>\n"
+                    "#if defined(__x86_64__) && defined(__GLIBC__)\n"
+                    "// Vector variants from libmvec\n";
+         for (const char *tFunction : {"sin", "cos", "exp"})
+         {
+            tSource << "#pragma omp declare simd notinbranch\n"
+                    << "extern \"C\" double " << tFunction << "(double);\n";
+         }
+         tSource << "#pragma omp declare simd notinbranch\n"
+                    "extern \"C\" double pow(double, double);\n"
+                    "#endif\n\n";
+         tSource << "// Parameter values, bound once when the kernel is loaded\n"
+                    "static const double *ls_parameters;\n"
+                    "extern \"C\" void ls_set_parameters(const double *aValues) { ls_parameters = aValues; }\n\n";
+
+         tSource << "extern \"C\" void ls_grid(const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ, double *aPhi)\n{\n";
+         native_constants(tSource, "   ");
+         tSource << "   const double r2 = aZ;\n";
+         native_code(tSource, mSliceCode, "   ");
+         tSource << "   for (size_t iX = 0; iX < aNumX; iX++)\n   {\n"
+                    "      const double r0 = aXs[iX];\n";
+         native_code(tSource, mRowCode, "      ");
+         tSource << "#pragma omp simd\n"
+                    "      for (size_t iY = 0; iY < aNumY; iY++)\n      {\n"
+                    "         const double r1 = aYs[iY];\n";
+         native_code(tSource, mPointCode, "         ");
+         tSource << "         aPhi[iX * aNumY + iY] = r" << mOutput << ";\n      }\n   }\n}\n\n";
+
+         tSource << "extern \"C\" void ls_batch(const double *aX, const double *aY, const double *aZ, double *aPhi, size_t aCount)\n{\n";
+         native_constants(tSource, "   ");
+         tSource << "#pragma omp simd\n"
+                    "   for (size_t iP = 0; iP < aCount; iP++)\n   {\n"
+                    "      const double r0 = aX[iP];\n"
+                    "      const double r1 = aY[iP];\n"
+                    "      const double r2 = aZ[iP];\n";
+         native_code(tSource, mCode, "      ");
+         tSource << "      aPhi[iP] = r" << mOutput << ";\n   }\n}\n";
+         return tSource.str();
+      }
+#endif
+
+    private:
+      static constexpr uint VECS = VM_BLOCK / simd::WIDTH; // Vectors per register
+
+      // Bits of a register's coordinate dependencies
+      static constexpr uint DEPENDS_X = 1;
+      static constexpr uint DEPENDS_Y = 2;
+      static constexpr uint DEPENDS_Z = 4;
+
+      // Vector slots per register of a dual evaluation: the value followed by the x, y and z derivatives.
+      // Slot k of register r is at (r * DUAL + k) * VECS, so the plain register helpers take r * DUAL + k
+      static constexpr uint DUAL = 4;
+
+      using Code = std::vector<std::pair<uint, Instruction>>; // Instructions with the register they write
+
+      // Storage of one register
+      struct Register
+      {
+         simd::vec mVecs[VECS];
+      };
+
+      // Scratch registers of the calling thread, with the constants already broadcast
+      simd::vec *registers() const
+      {
+         thread_local std::vector<Register> tRegs;
+         tRegs.resize(mNumRegisters);
+         simd::vec *tData = reinterpret_cast<simd::vec *>(tRegs.data());
+         for_each_constant([tData](uint aReg, double aValue)
+                           { broadcast(tData, aReg, aValue); });
+         return tData;
+      }
+
+      // Calls aFunction(register, value) for every constant register, parameters with their current value
+      template <typename Function>
+      void for_each_constant(Function aFunction) const
+      {
+         for (const auto &[tReg, tValue] : mConstants)
+         {
+            aFunction(tReg, tValue);
+         }
+         for (const auto &[tReg, tParameter] : mParameters)
+         {
+            aFunction(tReg, gParameterValues[tParameter]);
+         }
+      }
+
+      /**
+       * Creates a program from built code and sorts its instructions by what they depend on. aDepends receives
+       * the coordinate dependencies of every register
+       */
+      static std::shared_ptr<LSProgram> build(const CodeBuilder &aBuilder, const std::vector<uint> &aOutputs, std::vector<uint> &aDepends)
+      {
+         auto tProgram = std::make_shared<LSProgram>();
+         tProgram->mOutputs = aOutputs;
+         tProgram->mOutput = aOutputs[0];
+         tProgram->mNumRegisters = aBuilder.code().size();
+
+         // Which of x, y and z every register depends on
+         aDepends = {DEPENDS_X, DEPENDS_Y, DEPENDS_Z};
+
+         // Constants are broadcast once per call, everything else runs for every block. On a grid the
+         // instructions that don't depend on y only run once per row, or once per call without x either
+         for (uint iReg = 3; iReg < aBuilder.code().size(); iReg++)
+         {
+            const Instruction &tInstruction = aBuilder.code()[iReg];
+            if (tInstruction.mOp == OPCODE::CONST)
+            {
+               aDepends.push_back(0);
+               tProgram->mConstants.push_back({iReg, tInstruction.mValue});
+               continue;
+            }
+            if (tInstruction.mOp == OPCODE::PARAM)
+            {
+               aDepends.push_back(0);
+               tProgram->mParameters.push_back({iReg, tInstruction.mA});
+               continue;
+            }
+
+            uint tMask = aDepends[tInstruction.mA] | (is_unary(tInstruction.mOp) ? 0 : aDepends[tInstruction.mB]);
+            aDepends.push_back(tMask);
+            tProgram->mCode.push_back({iReg, tInstruction});
+            if (tMask & DEPENDS_Y)
+            {
+               tProgram->mPointCode.push_back({iReg, tInstruction});
+               if (!(tMask & DEPENDS_X))
+               {
+                  tProgram->mColumnCode.push_back({iReg, tInstruction});
+               }
+            }
+            else if (tMask & DEPENDS_X)
+            {
+               tProgram->mRowCode.push_back({iReg, tInstruction});
+            }
+            else
+            {
+               tProgram->mSliceCode.push_back({iReg, tInstruction});
+            }
+         }
+         return tProgram;
+      }
+
+      // A value and its gradient
+      struct Dual
+      {
+         double mValue;
+         double mGradient[3];
+      };
+
+      // A term of a separable program, subtracted from a sum or dividing a product when mInverse is set
+      struct Term
+      {
+         uint mReg;
+         bool mInverse;
+      };
+
+      /**
+       * Collects the terms of the sum or product rooted at aReg. Fails if a term depends on both x and y
+       */
+      bool split_terms(const std::vector<Instruction> &aCode, const std::vector<uint> &aDepends, uint aReg, bool aInverse)
+      {
+         const Instruction &tInstruction = aCode[aReg];
+         if (aReg >= 3)
+         {
+            // Sums also take apart negations, products pull them into the sign
+            if ((!mProduct && (tInstruction.mOp == OPCODE::ADD || tInstruction.mOp == OPCODE::SUB)) ||
+                (mProduct && (tInstruction.mOp == OPCODE::MUL || tInstruction.mOp == OPCODE::DIV)))
+            {
+               bool tInverseB = tInstruction.mOp == OPCODE::SUB || tInstruction.mOp == OPCODE::DIV;
+               return split_terms(aCode, aDepends, tInstruction.mA, aInverse) &&
+                      split_terms(aCode, aDepends, tInstruction.mB, aInverse != tInverseB);
+            }
+            if (tInstruction.mOp == OPCODE::NEG)
+            {
+               if (mProduct)
+               {
+                  mSign = -mSign;
+                  return split_terms(aCode, aDepends, tInstruction.mA, aInverse);
+               }
+               return split_terms(aCode, aDepends, tInstruction.mA, !aInverse);
+            }
+         }
+
+         if ((aDepends[aReg] & DEPENDS_X) && (aDepends[aReg] & DEPENDS_Y))
+         {
+            return false;
+         }
+         (aDepends[aReg] & DEPENDS_Y ? mColumnTerms : mRowTerms).push_back({aReg, aInverse});
+         return true;
+      }
+
+      // Adds (or multiplies) a term into the running combination of a row or column
+      void combine(Dual &aTotal, const Dual &aTerm, bool aInverse) const
+      {
+         if (!mProduct)
+         {
+            double tSign = aInverse ? -1.0 : 1.0;
+            aTotal.mValue += tSign * aTerm.mValue;
+            for (uint iDim = 0; iDim < 3; iDim++)
+            {
+               aTotal.mGradient[iDim] += tSign * aTerm.mGradient[iDim];
+            }
+         }
+         else if (!aInverse)
+         {
+            for (uint iDim = 0; iDim < 3; iDim++)
+            {
+               aTotal.mGradient[iDim] = aTotal.mGradient[iDim] * aTerm.mValue + aTotal.mValue * aTerm.mGradient[iDim];
+            }
+            aTotal.mValue *= aTerm.mValue;
+         }
+         else
+         {
+            aTotal.mValue /= aTerm.mValue;
+            for (uint iDim = 0; iDim < 3; iDim++)
+            {
+               aTotal.mGradient[iDim] = (aTotal.mGradient[iDim] - aTotal.mValue * aTerm.mGradient[iDim]) / aTerm.mValue;
+            }
+         }
+      }
+
+      /**
+       * Combines the terms of every lane of a block into aTotals, starting from aStart.
+       * aRegs holds plain registers, or dual ones if aDual is set
+       */
+      void combine_terms(const simd::vec *aRegs, bool aDual, const std::vector<Term> &aTerms, double aStart, Dual *aTotals, uint aNumLanes) const
+      {
+         for (uint iLane = 0; iLane < aNumLanes; iLane++)
+         {
+            aTotals[iLane] = {aStart, {0.0, 0.0, 0.0}};
+         }
+
+         double tLanes[DUAL][VM_BLOCK] = {};
+         uint tSlots = aDual ? DUAL : 1;
+         for (const Term &tTerm : aTerms)
+         {
+            for (uint k = 0; k < tSlots; k++)
+            {
+               for (uint v = 0; v < VECS; v++)
+               {
+                  simd::store(tLanes[k] + v * simd::WIDTH, aRegs[(tTerm.mReg * tSlots + k) * VECS + v]);
+               }
+            }
+            for (uint iLane = 0; iLane < aNumLanes; iLane++)
+            {
+               combine(aTotals[iLane], {tLanes[0][iLane], {tLanes[1][iLane], tLanes[2][iLane], tLanes[3][iLane]}}, tTerm.mInverse);
+            }
+         }
+      }
+
+      /**
+       * Grid evaluation of a separable program: the column terms are evaluated once per y, the row terms once per x,
+       * and every point only adds or multiplies the two. Gradients are filled in too if aGradient is given
+       */
+      void eval_grid_separable(const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ, double *aPhi, double *aGradient,
+                               size_t aGradientStride) const
+      {
+         bool tDual = aGradient != nullptr;
+         simd::vec *tRegs = tDual ? dual_registers() : registers();
+         uint tStride = tDual ? DUAL : 1;
+
+         broadcast(tRegs, 2 * tStride, aZ);
+         tDual ? run_block_dual(tRegs, mSliceCode) : run_block(tRegs, mSliceCode);
+
+         thread_local std::vector<Dual> tColumns;
+         tColumns.resize(aNumY + VM_BLOCK);
+         for (size_t iY = 0; iY < aNumY; iY += VM_BLOCK)
+         {
+            size_t tCount = std::min<size_t>(VM_BLOCK, aNumY - iY);
+            load_block(tRegs, tStride, aYs + iY, tCount);
+            tDual ? run_block_dual(tRegs, mColumnCode) : run_block(tRegs, mColumnCode);
+            combine_terms(tRegs, tDual, mColumnTerms, mProduct ? 1.0 : 0.0, &tColumns[iY], tCount);
+         }
+
+         for (size_t iX = 0; iX < aNumX; iX++)
+         {
+            broadcast(tRegs, 0, aXs[iX]);
+            tDual ? run_block_dual(tRegs, mRowCode) : run_block(tRegs, mRowCode);
+            // The sign of a product is carried by the row
+            Dual tRow;
+            combine_terms(tRegs, tDual, mRowTerms, mProduct ? mSign : 0.0, &tRow, 1);
+
+            double *tPhi = aPhi + iX * aNumY;
+            if (!mProduct)
+            {
+               for (size_t iY = 0; iY < aNumY; iY++)
+               {
+                  tPhi[iY] = tRow.mValue + tColumns[iY].mValue;
+               }
+            }
+            else
+            {
+               for (size_t iY = 0; iY < aNumY; iY++)
+               {
+                  tPhi[iY] = tRow.mValue * tColumns[iY].mValue;
+               }
+            }
+
+            if (tDual)
+            {
+               for (uint iDim = 0; iDim < 3; iDim++)
+               {
+                  double *tGradient = aGradient + iDim * aGradientStride + iX * aNumY;
+                  if (!mProduct)
+                  {
+                     for (size_t iY = 0; iY < aNumY; iY++)
+                     {
+                        tGradient[iY] = tRow.mGradient[iDim] + tColumns[iY].mGradient[iDim];
+                     }
+                  }
+                  else
+                  {
+                     for (size_t iY = 0; iY < aNumY; iY++)
+                     {
+                        tGradient[iY] = tRow.mGradient[iDim] * tColumns[iY].mValue + tRow.mValue * tColumns[iY].mGradient[iDim];
+                     }
+                  }
+               }
+            }
+         }
+      }
+
+      /**
+       * Grid evaluation block by block, with the loop invariant code hoisted. Writes every output,
+       * with gradients if aGradients is given
+       */
+      void eval_grid_blocks(const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ,
+                            double *const *aPhis, double *const *aGradients, size_t aGradientStride) const
+      {
+         bool tDual = aGradients != nullptr;
+         simd::vec *tRegs = tDual ? dual_registers() : registers();
+         uint tStride = tDual ? DUAL : 1;
+
+         broadcast(tRegs, 2 * tStride, aZ);
+         tDual ? run_block_dual(tRegs, mSliceCode) : run_block(tRegs, mSliceCode);
+         for (size_t iX = 0; iX < aNumX; iX++)
+         {
+            broadcast(tRegs, 0, aXs[iX]);
+            tDual ? run_block_dual(tRegs, mRowCode) : run_block(tRegs, mRowCode);
+            for (size_t iY = 0; iY < aNumY; iY += VM_BLOCK)
+            {
+               size_t tCount = std::min<size_t>(VM_BLOCK, aNumY - iY);
+               load_block(tRegs, tStride, aYs + iY, tCount);
+               tDual ? run_block_dual(tRegs, mPointCode) : run_block(tRegs, mPointCode);
+
+               size_t tOffset = iX * aNumY + iY;
+               for (size_t iOut = 0; iOut < mOutputs.size(); iOut++)
+               {
+                  if (tDual)
+                  {
+                     store_block_dual(tRegs, mOutputs[iOut], aPhis[iOut] + tOffset, aGradients[iOut] + tOffset, aGradientStride, tCount);
+                  }
+                  else
+                  {
+                     store_block(tRegs, mOutputs[iOut], aPhis[iOut] + tOffset, tCount);
+                  }
+               }
+            }
+         }
+      }
+
+      // Dual scratch registers of the calling thread, with the constants and the coordinate derivatives set
+      simd::vec *dual_registers() const
+      {
+         thread_local std::vector<Register> tRegs;
+         tRegs.resize(DUAL * mNumRegisters);
+         simd::vec *tData = reinterpret_cast<simd::vec *>(tRegs.data());
+         for (uint iReg = 0; iReg < 3; iReg++)
+         {
+            for (uint iDim = 0; iDim < 3; iDim++)
+            {
+               broadcast(tData, iReg * DUAL + 1 + iDim, iReg == iDim ? 1.0 : 0.0);
+            }
+         }
+         for_each_constant([tData](uint aReg, double aValue)
+                           {
+            broadcast(tData, aReg * DUAL, aValue);
+            for (uint iDim = 0; iDim < 3; iDim++)
+            {
+               broadcast(tData, aReg * DUAL + 1 + iDim, 0.0);
+            } });
+         return tData;
+      }
+
+      static void broadcast(simd::vec *aRegs, uint aReg, double aValue)
+      {
+         for (uint v = 0; v < VECS; v++)
+         {
+            aRegs[aReg * VECS + v] = simd::set1(aValue);
+         }
+      }
+
+      // Loads up to VM_BLOCK values into a register, a partial block repeats its last value
+      static void load_block(simd::vec *aRegs, uint aReg, const double *aValues, size_t aCount)
+      {
+         if (aCount == VM_BLOCK)
+         {
+            for (uint v = 0; v < VECS; v++)
+            {
+               aRegs[aReg * VECS + v] = simd::load(aValues + v * simd::WIDTH);
+            }
+            return;
+         }
+
+         double tPadded[VM_BLOCK];
+         for (uint iLane = 0; iLane < VM_BLOCK; iLane++)
+         {
+            tPadded[iLane] = aValues[std::min<size_t>(iLane, aCount - 1)];
+         }
+         load_block(aRegs, aReg, tPadded, VM_BLOCK);
+      }
+
+      static void store_block(const simd::vec *aRegs, uint aReg, double *aPhi, size_t aCount)
+      {
+         double tBlock[VM_BLOCK];
+         for (uint v = 0; v < VECS; v++)
+         {
+            simd::store(tBlock + v * simd::WIDTH, aRegs[aReg * VECS + v]);
+         }
+         std::copy(tBlock, tBlock + aCount, aPhi);
+      }
+
+      // Stores the value to aPhi and the derivatives to the planes of aGradient, aGradientStride apart
+      static void store_block_dual(const simd::vec *aRegs, uint aReg, double *aPhi, double *aGradient, size_t aGradientStride, size_t aCount)
+      {
+         store_block(aRegs, aReg * DUAL, aPhi, aCount);
+         for (uint iDim = 0; iDim < 3; iDim++)
+         {
+            store_block(aRegs, aReg * DUAL + 1 + iDim, aGradient + iDim * aGradientStride, aCount);
+         }
+      }
+
+#ifdef JIT
+      // Declares the constant registers, as exact hexadecimal literals, and reads the parameters
+      void native_constants(std::ostringstream &aSource, const std::string &aIndent) const
+      {
+         for (const auto &[tReg, tParameter] : mParameters)
+         {
+            aSource << aIndent << "const double r" << tReg << " = ls_parameters[" << tParameter << "];\n";
+         }
+         for (const auto &[tReg, tValue] : mConstants)
+         {
+            aSource << aIndent << "const double r" << tReg << " = ";
+            if (std::isnan(tValue))
+            {
+               aSource << "__builtin_nan(\"\")";
+            }
+            else if (std::isinf(tValue))
+            {
+               aSource << (tValue < 0 ? "-" : "") << "__builtin_inf()";
+            }
+            else
+            {
+               aSource << std::hexfloat << tValue << std::defaultfloat;
+            }
+            aSource << ";\n";
+         }
+      }
+
+      // Writes one statement per instruction
+      static void native_code(std::ostringstream &aSource, const Code &aCode, const std::string &aIndent)
+      {
+         for (const auto &[tDst, tInstruction] : aCode)
+         {
+            std::string a = "r" + std::to_string(tInstruction.mA);
+            std::string b = "r" + std::to_string(tInstruction.mB);
+            aSource << aIndent << "const double r" << tDst << " = ";
+            switch (tInstruction.mOp)
+            {
+            case OPCODE::NEG:
+               aSource << "-" << a;
+               break;
+            case OPCODE::ADD:
+               aSource << a << " + " << b;
+               break;
+            case OPCODE::SUB:
+               aSource << a << " - " << b;
+               break;
+            case OPCODE::MUL:
+               aSource << a << " * " << b;
+               break;
+            case OPCODE::DIV:
+               aSource << a << " / " << b;
+               break;
+            case OPCODE::POW:
+               aSource << "pow(" << a << ", " << b << ")";
+               break;
+            case OPCODE::MIN:
+               aSource << a << " < " << b << " ? " << a << " : " << b;
+               break;
+            case OPCODE::MAX:
+               aSource << a << " > " << b << " ? " << a << " : " << b;
+               break;
+            case OPCODE::ABS:
+               aSource << "fabs(" << a << ")";
+               break;
+            case OPCODE::SQRT:
+               aSource << "sqrt(" << a << ")";
+               break;
+            case OPCODE::SIN:
+               aSource << "sin(" << a << ")";
+               break;
+            case OPCODE::COS:
+               aSource << "cos(" << a << ")";
+               break;
+            case OPCODE::TAN:
+               aSource << "tan(" << a << ")";
+               break;
+            case OPCODE::EXP:
+               aSource << "exp(" << a << ")";
+               break;
+            default:
+               aSource << "__builtin_nan(\"\")";
+            }
+            aSource << ";\n";
+         }
+      }
+#endif
+
+      // Executes a list of instructions on one block of points
+      static void run_block(simd::vec *aRegs, const Code &aCode)
+      {
+         for (const auto &[tDst, tInstruction] : aCode)
+         {
+            simd::vec *d = aRegs + tDst * VECS;
+            const simd::vec *a = aRegs + tInstruction.mA * VECS;
+            const simd::vec *b = aRegs + tInstruction.mB * VECS;
+
+            switch (tInstruction.mOp)
+            {
+            case OPCODE::NEG:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::neg(a[v]);
+               break;
+            case OPCODE::ADD:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::add(a[v], b[v]);
+               break;
+            case OPCODE::SUB:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::sub(a[v], b[v]);
+               break;
+            case OPCODE::MUL:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::mul(a[v], b[v]);
+               break;
+            case OPCODE::DIV:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::div(a[v], b[v]);
+               break;
+            case OPCODE::MIN:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::min(a[v], b[v]);
+               break;
+            case OPCODE::MAX:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::max(a[v], b[v]);
+               break;
+            case OPCODE::ABS:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::abs(a[v]);
+               break;
+            case OPCODE::SQRT:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::sqrt(a[v]);
+               break;
+            case OPCODE::SIN:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::sin_cos(a[v], false);
+               break;
+            case OPCODE::COS:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::sin_cos(a[v], true);
+               break;
+            case OPCODE::TAN:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::div(simd::sin_cos(a[v], false), simd::sin_cos(a[v], true));
+               break;
+            case OPCODE::EXP:
+               for (uint v = 0; v < VECS; v++)
+                  d[v] = simd::exp(a[v]);
+               break;
+            default:
+            {
+               // No vector kernel (non-integer powers), evaluate lane by lane
+               double tA[VM_BLOCK], tB[VM_BLOCK];
+               for (uint v = 0; v < VECS; v++)
+               {
+                  simd::store(tA + v * simd::WIDTH, a[v]);
+                  simd::store(tB + v * simd::WIDTH, b[v]);
+               }
+               for (uint iLane = 0; iLane < VM_BLOCK; iLane++)
+               {
+                  tA[iLane] = apply_op(tInstruction.mOp, tA[iLane], tB[iLane]);
+               }
+               for (uint v = 0; v < VECS; v++)
+               {
+                  d[v] = simd::load(tA + v * simd::WIDTH);
+               }
+            }
+            }
+         }
+      }
+
+      // Executes a list of instructions on one block of dual numbers. Every instruction computes its value and the
+      // partial derivatives dA, dB by its operands, the chain rule then gives d = dA * a' + dB * b'
+      static void run_block_dual(simd::vec *aRegs, const Code &aCode)
+      {
+         const simd::vec tZero = simd::set1(0.0);
+         const simd::vec tOne = simd::set1(1.0);
+
+         for (const auto &[tDst, tInstruction] : aCode)
+         {
+            simd::vec *d = aRegs + tDst * DUAL * VECS;
+            const simd::vec *a = aRegs + tInstruction.mA * DUAL * VECS;
+            const simd::vec *b = aRegs + tInstruction.mB * DUAL * VECS;
+
+            simd::vec tValue[VECS], dA[VECS], dB[VECS];
+            for (uint v = 0; v < VECS; v++)
+            {
+               dB[v] = tZero;
+            }
+
+            switch (tInstruction.mOp)
+            {
+            case OPCODE::NEG:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::neg(a[v]);
+                  dA[v] = simd::set1(-1.0);
+               }
+               break;
+            case OPCODE::ADD:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::add(a[v], b[v]);
+                  dA[v] = tOne;
+                  dB[v] = tOne;
+               }
+               break;
+            case OPCODE::SUB:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::sub(a[v], b[v]);
+                  dA[v] = tOne;
+                  dB[v] = simd::set1(-1.0);
+               }
+               break;
+            case OPCODE::MUL:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::mul(a[v], b[v]);
+                  dA[v] = b[v];
+                  dB[v] = a[v];
+               }
+               break;
+            case OPCODE::DIV:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::div(a[v], b[v]);
+                  dA[v] = simd::div(tOne, b[v]);
+                  dB[v] = simd::neg(simd::div(tValue[v], b[v]));
+               }
+               break;
+            case OPCODE::MIN:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  simd::vec tPickA = simd::cmp_lt(a[v], b[v]);
+                  tValue[v] = simd::min(a[v], b[v]);
+                  dA[v] = simd::select(tPickA, tZero, tOne);
+                  dB[v] = simd::select(tPickA, tOne, tZero);
+               }
+               break;
+            case OPCODE::MAX:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  simd::vec tPickA = simd::cmp_lt(b[v], a[v]);
+                  tValue[v] = simd::max(a[v], b[v]);
+                  dA[v] = simd::select(tPickA, tZero, tOne);
+                  dB[v] = simd::select(tPickA, tOne, tZero);
+               }
+               break;
+            case OPCODE::ABS:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::abs(a[v]);
+                  dA[v] = simd::select(simd::cmp_lt(a[v], tZero), tOne, simd::set1(-1.0));
+               }
+               break;
+            case OPCODE::SQRT:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::sqrt(a[v]);
+                  dA[v] = simd::div(simd::set1(0.5), tValue[v]);
+               }
+               break;
+            case OPCODE::SIN:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::sin_cos(a[v], false);
+                  dA[v] = simd::sin_cos(a[v], true);
+               }
+               break;
+            case OPCODE::COS:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::sin_cos(a[v], true);
+                  dA[v] = simd::neg(simd::sin_cos(a[v], false));
+               }
+               break;
+            case OPCODE::TAN:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  simd::vec tCos = simd::sin_cos(a[v], true);
+                  tValue[v] = simd::div(simd::sin_cos(a[v], false), tCos);
+                  dA[v] = simd::div(tOne, simd::mul(tCos, tCos));
+               }
+               break;
+            case OPCODE::EXP:
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::exp(a[v]);
+                  dA[v] = tValue[v];
+               }
+               break;
+            default:
+            {
+               // No vector kernel (non-integer powers), evaluate lane by lane.
+               // The log(a) term is left out where the exponent is constant, so negative bases keep a finite derivative
+               double tA[VM_BLOCK], tB[VM_BLOCK], tPartialB[VM_BLOCK];
+               bool tConstantB[VM_BLOCK];
+               for (uint v = 0; v < VECS; v++)
+               {
+                  simd::store(tA + v * simd::WIDTH, a[v]);
+                  simd::store(tB + v * simd::WIDTH, b[v]);
+               }
+               std::fill(tConstantB, tConstantB + VM_BLOCK, true);
+               for (uint k = 1; k < DUAL; k++)
+               {
+                  for (uint v = 0; v < VECS; v++)
+                  {
+                     simd::store(tPartialB + v * simd::WIDTH, b[k * VECS + v]);
+                  }
+                  for (uint iLane = 0; iLane < VM_BLOCK; iLane++)
+                  {
+                     tConstantB[iLane] = tConstantB[iLane] && tPartialB[iLane] == 0.0;
+                  }
+               }
+
+               double tValues[VM_BLOCK], tDA[VM_BLOCK], tDB[VM_BLOCK];
+               for (uint iLane = 0; iLane < VM_BLOCK; iLane++)
+               {
+                  tValues[iLane] = apply_op(tInstruction.mOp, tA[iLane], tB[iLane]);
+                  tDA[iLane] = tB[iLane] * std::pow(tA[iLane], tB[iLane] - 1.0);
+                  tDB[iLane] = tConstantB[iLane] ? 0.0 : tValues[iLane] * std::log(tA[iLane]);
+               }
+               for (uint v = 0; v < VECS; v++)
+               {
+                  tValue[v] = simd::load(tValues + v * simd::WIDTH);
+                  dA[v] = simd::load(tDA + v * simd::WIDTH);
+                  dB[v] = simd::load(tDB + v * simd::WIDTH);
+               }
+            }
+            }
+
+            for (uint v = 0; v < VECS; v++)
+            {
+               d[v] = tValue[v];
+            }
+            for (uint k = 1; k < DUAL; k++)
+            {
+               for (uint v = 0; v < VECS; v++)
+               {
+                  d[k * VECS + v] = simd::add(simd::mul(dA[v], a[k * VECS + v]), simd::mul(dB[v], b[k * VECS + v]));
+               }
+            }
+         }
+      }
+
+      Code mCode;                                      // All instructions in order
+      Code mSliceCode;                                 // Instructions that depend on z at most
+      Code mRowCode;                                   // Instructions that depend on x but not y
+      Code mPointCode;                                 // Instructions that depend on y
+      Code mColumnCode;                                // Instructions that depend on y but not x
+      bool mSeparable = false;                         // Grids are evaluated as an outer sum or product
+      bool mProduct = false;                           // The separable terms multiply instead of adding up
+      double mSign = 1.0;                              // Sign of a separable product
+      std::vector<Term> mRowTerms;                     // Separable terms that don't depend on y
+      std::vector<Term> mColumnTerms;                  // Separable terms that depend on y
+      std::vector<std::pair<uint, double>> mConstants; // Constant registers and their values
+      std::vector<std::pair<uint, uint>> mParameters;  // Parameter registers and the parameters they hold
+      uint mNumRegisters = 0;
+      uint mOutput = 0;                                // Register holding phi
+      std::vector<uint> mOutputs;                      // Registers holding phi of every expression of a scene
+   };
+
+   //-----------------------------------------------------------------------
+
+#ifdef JIT
+   /**
+    * Natively compiled kernel of a level-set. Starts out empty and is filled in once a background compile
+    * has been loaded and checked, evaluation falls back to the bytecode or exprtk until then
+    */
+   class NativeKernel
+   {
+    public:
+      using GridFunction = void (*)(const double *, size_t, const double *, size_t, double, double *);
+      using BatchFunction = void (*)(const double *, const double *, const double *, double *, size_t);
+
+      NativeKernel() = default;
+      NativeKernel(const NativeKernel &) = delete;
+      NativeKernel &operator=(const NativeKernel &) = delete;
+
+      ~NativeKernel()
+      {
+         if (mHandle)
+         {
+            dlclose(mHandle);
+         }
+      }
+
+      GridFunction grid() const
+      {
+         return mGrid.load(std::memory_order_acquire);
+      }
+
+      BatchFunction batch() const
+      {
+         return mBatch.load(std::memory_order_acquire);
+      }
+
+      /**
+       * Opens a compiled kernel, binds it to the parameter values and publishes it if aCheck accepts its batch function
+       */
+      bool load(const std::string &aLibrary, const std::function<bool(BatchFunction)> &aCheck)
+      {
+         void *tHandle = dlopen(aLibrary.c_str(), RTLD_NOW | RTLD_LOCAL);
+         if (!tHandle)
+         {
+            return false;
+         }
+
+         auto tGrid = reinterpret_cast<GridFunction>(dlsym(tHandle, "ls_grid"));
+         auto tBatch = reinterpret_cast<BatchFunction>(dlsym(tHandle, "ls_batch"));
+         auto tSetParameters = reinterpret_cast<void (*)(const double *)>(dlsym(tHandle, "ls_set_parameters"));
+         if (!tGrid || !tBatch || !tSetParameters)
+         {
+            dlclose(tHandle);
+            return false;
+         }
+
+         tSetParameters(gParameterValues);
+         if (!aCheck(tBatch))
+         {
+            dlclose(tHandle);
+            return false;
+         }
+
+         mHandle = tHandle;
+         mBatch.store(tBatch, std::memory_order_release);
+         mGrid.store(tGrid, std::memory_order_release);
+         return true;
+      }
+
+    private:
+      void *mHandle = nullptr;
+      std::atomic<GridFunction> mGrid{nullptr};
+      std::atomic<BatchFunction> mBatch{nullptr};
+   };
+
+   //-----------------------------------------------------------------------
+#endif
+
+   /**
+    * Gets the slot for the calling thread's evaluation context of a level-set.
+    * Every thread compiles its own context the first time it evaluates a level-set. aOwner expires once no copy of the
+    * level-set is left, and the contexts of expired level-sets are dropped before a thread adds another one
+    */
+   std::unique_ptr<LSContext> &thread_context(uint aId, const std::weak_ptr<const void> &aOwner)
+   {
+      struct Slot
+      {
+         std::weak_ptr<const void> mOwner;
+         std::unique_ptr<LSContext> mContext;
+      };
+      thread_local std::unordered_map<uint, Slot> tContexts;
+
+      auto tFound = tContexts.find(aId);
+      if (tFound != tContexts.end())
+      {
+         return tFound->second.mContext;
+      }
+
+      for (auto iSlot = tContexts.begin(); iSlot != tContexts.end();)
+      {
+         iSlot = iSlot->second.mOwner.expired() ? tContexts.erase(iSlot) : std::next(iSlot);
+      }
+      Slot &tSlot = tContexts[aId];
+      tSlot.mOwner = aOwner;
+      return tSlot.mContext;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Level-set function phi(x,y,z). Only holds the parsed source and a unique id, evaluation goes
+    * through the calling thread's LSContext so level-sets can be copied and shared between threads
+    */
+   class LS
+   {
+    public:
+      LS() = default;
+
+      LS(const std::string &aSource, uint aId, std::shared_ptr<const void> aOwner, std::shared_ptr<const LSProgram> aProgram,
+         const std::vector<uint> &aParameters)
+          : mSource(aSource), mId(aId), mOwner(aOwner), mProgram(aProgram), mParameters(aParameters)
+      {
+      }
+
+      const std::string &source() const
+      {
+         return mSource;
+      }
+
+      uint id() const
+      {
+         return mId;
+      }
+
+      bool empty() const
+      {
+         return mId == 0;
+      }
+
+      // Indices of the parameters the expression uses
+      const std::vector<uint> &parameters() const
+      {
+         return mParameters;
+      }
+
+      // Bytecode of the expression, nullptr if it has to be evaluated by exprtk
+      const LSProgram *program() const
+      {
+         return mProgram.get();
+      }
+
+#ifdef JIT
+      // Native kernel of the expression, nullptr if none is being compiled
+      const NativeKernel *native() const
+      {
+         return mNative.get();
+      }
+
+      void set_native(std::shared_ptr<const NativeKernel> aNative)
+      {
+         mNative = aNative;
+      }
+#endif
+
+      // Evaluation context of the calling thread
+      LSContext &context() const
+      {
+         std::unique_ptr<LSContext> &tContext = thread_context(mId, mOwner);
+         if (!tContext)
+         {
+            tContext = std::make_unique<LSContext>(mSource);
+         }
+         return *tContext;
+      }
+
+    private:
+      std::string mSource;                      // Expression the level-set was parsed from
+      uint mId = 0;                             // Unique id of the parsed level-set, 0 for an empty level-set
+      std::shared_ptr<const void> mOwner;        // Shared by the copies of the level-set, its evaluation contexts go with it
+      std::shared_ptr<const LSProgram> mProgram; // Shared, immutable bytecode
+      std::vector<uint> mParameters;             // Parameters the expression uses
+#ifdef JIT
+      std::shared_ptr<const NativeKernel> mNative; // Shared native kernel, filled in by a background compile
+#endif
+   };
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Persistent pool of worker threads. parallel_for hands out task indices to the workers and blocks until every
+    * task is done. Each task writes its own part of the output, so results don't depend on the scheduling.
+    * Tasks must not call parallel_for themselves
+    */
+   class ThreadPool
+   {
+    public:
+      explicit ThreadPool(uint aNumThreads)
+      {
+         for (uint iThread = 0; iThread < std::max(1u, aNumThreads); iThread++)
+         {
+            mWorkers.emplace_back(&ThreadPool::worker_loop, this);
+         }
+      }
+
+      ~ThreadPool()
+      {
+         {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+         }
+         mWake.notify_all();
+         for (std::thread &tWorker : mWorkers)
+         {
+            tWorker.join();
+         }
+      }
+
+      uint num_threads() const
+      {
+         return mWorkers.size();
+      }
+
+      /**
+       * Runs aTask(iTask) for every iTask in [0, aNumTasks) on the workers
+       */
+      void parallel_for(uint aNumTasks, const std::function<void(uint)> &aTask)
+      {
+         if (aNumTasks == 0)
+         {
+            return;
+         }
+
+         // One job at a time, callers from other threads wait here
+         std::lock_guard<std::mutex> tJobLock(mJobMutex);
+
+         std::unique_lock<std::mutex> lock(mMutex);
+         mTask = &aTask;
+         mNumTasks = aNumTasks;
+         mNextTask = 0;
+         mActive = mWorkers.size();
+         mJob++;
+         mWake.notify_all();
+
+         mDone.wait(lock, [this]()
+                    { return mActive == 0; });
+         mTask = nullptr;
+      }
+
+    private:
+      void worker_loop()
+      {
+         uint tLastJob = 0;
+         while (true)
+         {
+            const std::function<void(uint)> *tTask;
+            uint tNumTasks;
+            {
+               std::unique_lock<std::mutex> lock(mMutex);
+               mWake.wait(lock, [&]()
+                          { return mStop || mJob != tLastJob; });
+               if (mStop)
+               {
+                  return;
+               }
+               tLastJob = mJob;
+               tTask = mTask;
+               tNumTasks = mNumTasks;
+            }
+
+            // Grab tasks until none are left
+            for (uint iTask = mNextTask++; iTask < tNumTasks; iTask = mNextTask++)
+            {
+               (*tTask)(iTask);
+            }
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (--mActive == 0)
+            {
+               mDone.notify_one();
+            }
+         }
+      }
+
+      std::vector<std::thread> mWorkers;
+      std::mutex mJobMutex;                            // Serializes parallel_for calls
+      std::mutex mMutex;                               // Protects the job state below
+      std::condition_variable mWake;                   // Signals a new job or shutdown to the workers
+      std::condition_variable mDone;                   // Signals the end of a job to the caller
+      const std::function<void(uint)> *mTask = nullptr; // Task of the current job
+      uint mNumTasks = 0;                              // Number of tasks in the current job
+      std::atomic<uint> mNextTask{0};                  // Next task index to hand out
+      uint mActive = 0;                                // Workers that haven't finished the current job
+      uint mJob = 0;                                   // Incremented for every job
+      bool mStop = false;                              // Set when the pool shuts down
+   };
+
+   /**
+    * Gets the grid evaluation pool, started on first use with NUM_THREADS workers
+    */
+   ThreadPool &thread_pool()
+   {
+      static ThreadPool tPool(NUM_THREADS > 0 ? NUM_THREADS : std::thread::hardware_concurrency());
+      return tPool;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Triangle strips with optional per-vertex normals, cached so they can be redrawn without re-evaluating.
+    * Vertices are stored as (x,y,z) triples, mStripStarts holds the index of the first vertex of each strip
+    */
+   struct StripMesh
+   {
+      std::vector<double> mVertices;
+      std::vector<double> mNormals;
+      std::vector<uint> mStripStarts;
+
+      void clear()
+      {
+         mVertices.clear();
+         mNormals.clear();
+         mStripStarts.clear();
+      }
+
+      uint num_vertices() const
+      {
+         return mVertices.size() / 3;
+      }
+
+      uint num_strips() const
+      {
+         return mStripStarts.size();
+      }
+
+      // One past the last vertex of a strip
+      uint strip_end(uint aStrip) const
+      {
+         return aStrip + 1 < num_strips() ? mStripStarts[aStrip + 1] : num_vertices();
+      }
+
+      void begin_strip()
+      {
+         mStripStarts.push_back(num_vertices());
+      }
+
+      void add_vertex(double aX, double aY, double aZ)
+      {
+         mVertices.insert(mVertices.end(), {aX, aY, aZ});
+      }
+
+      void add_vertex(double aX, double aY, double aZ, double aNx, double aNy, double aNz)
+      {
+         add_vertex(aX, aY, aZ);
+         mNormals.insert(mNormals.end(), {aNx, aNy, aNz});
+      }
+   };
+
+   /**
+    * Indexed triangle mesh with per-vertex normals. Vertices and normals are stored as (x,y,z) triples in level-set
+    * coordinates, mIndices holds three vertices per triangle
+    */
+   struct TriangleMesh
+   {
+      std::vector<double> mVertices;
+      std::vector<double> mNormals;
+      std::vector<uint> mIndices;
+
+      void clear()
+      {
+         mVertices.clear();
+         mNormals.clear();
+         mIndices.clear();
+      }
+
+      uint num_vertices() const
+      {
+         return mVertices.size() / 3;
+      }
+
+      uint num_triangles() const
+      {
+         return mIndices.size() / 3;
+      }
+   };
+
+   /**
+    * Convex polygons in the projection plane. Vertices are stored as (x,z) pairs, mPolygonStarts holds the index of the
+    * first vertex of each polygon
+    */
+   struct PolygonMesh
+   {
+      std::vector<double> mVertices;
+      std::vector<uint> mPolygonStarts;
+
+      void clear()
+      {
+         mVertices.clear();
+         mPolygonStarts.clear();
+      }
+
+      uint num_vertices() const
+      {
+         return mVertices.size() / 2;
+      }
+
+      uint num_polygons() const
+      {
+         return mPolygonStarts.size();
+      }
+
+      // One past the last vertex of a polygon
+      uint polygon_end(uint aPolygon) const
+      {
+         return aPolygon + 1 < num_polygons() ? mPolygonStarts[aPolygon + 1] : num_vertices();
+      }
+
+      // Adds a polygon from (x,z) pairs, polygons with fewer than 3 vertices are dropped
+      void add_polygon(const std::vector<double> &aVertices)
+      {
+         if (aVertices.size() >= 6)
+         {
+            mPolygonStarts.push_back(num_vertices());
+            mVertices.insert(mVertices.end(), aVertices.begin(), aVertices.end());
+         }
+      }
+
+      void append(const PolygonMesh &aOther)
+      {
+         for (uint tStart : aOther.mPolygonStarts)
+         {
+            mPolygonStarts.push_back(num_vertices() + tStart);
+         }
+         mVertices.insert(mVertices.end(), aOther.mVertices.begin(), aOther.mVertices.end());
+      }
+   };
+
+   /**
+    * Interface of one geometry in the projection plane as polylines. Every vertex is the root on one grid edge and is
+    * shared by the polylines through it. mPolylineStarts holds the first entry of each polyline in mIndices,
+    * closed polylines repeat their first vertex at the end. The positive side of the geometry is on the left
+    */
+   struct InterfaceCurves
+   {
+      std::vector<double> mVertices; // (x,z) pairs
+      std::vector<uint> mIndices;
+      std::vector<uint> mPolylineStarts;
+
+      void clear()
+      {
+         mVertices.clear();
+         mIndices.clear();
+         mPolylineStarts.clear();
+      }
+
+      uint num_vertices() const
+      {
+         return mVertices.size() / 2;
+      }
+
+      uint num_polylines() const
+      {
+         return mPolylineStarts.size();
+      }
+
+      // One past the last entry of a polyline in mIndices
+      uint polyline_end(uint aPolyline) const
+      {
+         return aPolyline + 1 < num_polylines() ? mPolylineStarts[aPolyline + 1] : mIndices.size();
+      }
+   };
+
+   /**
+    * What a field holds besides phi
+    */
+   enum class SAMPLING
+   {
+      VALUES,   // phi at every point
+      GRADIENT, // phi and its gradient at every point
+      SIGNS     // phi near the interface, +-infinity in tiles that interval bounds prove one-signed
+   };
+
+   /**
+    * Inputs that determine a sampled level-set field. The field only needs to be re-evaluated when one of these changes
+    */
+   struct FieldKey
+   {
+      std::string mSource;             // Level-set expression
+      double mXLB, mXUB, mZLB, mZUB;   // Domain bounds
+      double mSlice;                   // z-slice the field was sampled on
+      int mStride;                     // Every mStride-th point of the grid is sampled
+      SAMPLING mSampling;              // What was sampled
+      std::vector<double> mParameters; // Values of the parameters the expression uses
+
+      bool operator==(const FieldKey &aOther) const
+      {
+         return mSource == aOther.mSource && mXLB == aOther.mXLB && mXUB == aOther.mXUB && mZLB == aOther.mZLB &&
+                mZUB == aOther.mZUB && mSlice == aOther.mSlice && mStride == aOther.mStride && mSampling == aOther.mSampling &&
+                mParameters == aOther.mParameters;
+      }
+   };
+
+   /**
+    * Interface of a level-set on a z-slice from the adaptive quadtree, drawn over the projection when the overlay is on
+    */
+   struct RefinedInterface
+   {
+      FieldKey mKey;
+      int mDepth = 0;             // Finest level of the quadtree, 0 when unused
+      uint mLastUsed = 0;         // When the refiner last handed the interface out, to pick the one to replace
+      size_t mSamples = 0;        // Level-set evaluations the quadtree took
+      double mMilliseconds = 0.0; // Time the refinement took
+      InterfaceCurves mCurves;
+   };
+
+   /**
+    * Allocates storage aligned to FIELD_ALIGNMENT bytes
+    */
+   template <typename T>
+   struct AlignedAllocator
+   {
+      using value_type = T;
+
+      AlignedAllocator() = default;
+
+      template <typename U>
+      AlignedAllocator(const AlignedAllocator<U> &)
+      {
+      }
+
+      T *allocate(size_t aCount)
+      {
+         return static_cast<T *>(::operator new(aCount * sizeof(T), std::align_val_t(FIELD_ALIGNMENT)));
+      }
+
+      void deallocate(T *aData, size_t)
+      {
+         ::operator delete(aData, std::align_val_t(FIELD_ALIGNMENT));
+      }
+
+      template <typename U>
+      bool operator==(const AlignedAllocator<U> &) const
+      {
+         return true;
+      }
+
+      template <typename U>
+      bool operator!=(const AlignedAllocator<U> &) const
+      {
+         return false;
+      }
+   };
+
+   // Contiguous, aligned storage of sampled values. Resizing keeps the storage, so reused fields don't allocate
+   template <typename T>
+   using FieldBuffer = std::vector<T, AlignedAllocator<T>>;
+
+#ifdef FIELD_FLOAT
+   using FieldValue = float; // Precision of stored fields
+#else
+   using FieldValue = double; // Precision of stored fields
+#endif
+
+   /**
+    * Level-set values sampled on the grid, indexed [x][z]. Each quantity is a unit-stride plane of its own
+    */
+   struct Field
+   {
+      FieldKey mKey;
+      uint mVersion = 0;            // Unique for every evaluation so dependent meshes can detect changes. 0 means unused
+      mutable uint mLastUsed = 0;   // Frame the field was last requested in
+      uint mSampledFrame = 0;       // Frame the field was sampled, loaded or taken from the slice sampler in
+      mutable bool mStored = false; // Whether the field is on disk or queued to be written
+      FieldBuffer<FieldValue> mPhi;
+      FieldBuffer<FieldValue> mGradient; // Planes of dphi/dx, dphi/dy and dphi/dz indexed like mPhi, only for SAMPLING::GRADIENT
+
+      // Interface roots, filled in by edge_root as meshes need them and cleared when the field is sampled again
+      mutable FieldBuffer<double> mRoots;         // Root on every grid edge, numbered by edge_index, NaN until solved
+      mutable FieldBuffer<double> mRootGradients; // Gradient at each root, 3 per edge, only for SAMPLING::GRADIENT
+   };
+
+   /**
+    * Level-set sampled on the volume grid of the 3-D view, VOLUME_POINTS in every direction over the domain in x and y
+    * and the y-range in z, indexed [z][x][y]
+    */
+   struct VolumeField
+   {
+      FieldKey mKey;
+      uint mVersion = 0;          // Unique for every evaluation so dependent surfaces can detect changes. 0 means unused
+      mutable uint mLastUsed = 0; // Frame the volume was last requested in
+      FieldBuffer<FieldValue> mPhi;
+   };
+
+   /**
+    * Cached zero isosurface of a level-set in the 3-D view, and its pieces between the isosurfaces of the other geometries
+    */
+   struct VolumeSurface
+   {
+      uint mFieldVersion = 0;              // Version of the volume the isosurface was extracted from
+      TriangleMesh mIsosurface;            // Marching-cubes surface, every vertex is shared by the cells around its grid edge
+      std::vector<size_t> mVertexEdges;    // Volume grid edge of every isosurface vertex
+      std::vector<double> mVertexWeights;  // Position of every vertex along its edge, 0 at the start and 1 at the end
+      TriangleMesh mBoundary;              // Isosurface clipped at the isosurfaces of the other geometries
+      std::vector<uint> mPatchStarts;      // First entry in mBoundary.mIndices for every bitset of the other geometries, and the end
+   };
+
+   /**
+    * Cached surface of a level-set in the plotter view
+    */
+   struct SurfaceMesh
+   {
+      // One entry for each sign condition POSITIVE, NEGATIVE and ALL, so switching phases reuses the strips
+      uint mFieldVersion[3] = {0, 0, 0};       // Version of the field the strips were built from
+      bool mIsocontour[3] = {true, true, true}; // Isocontour flag the strips were built with
+      StripMesh mStrips[3];
+   };
+
+   //-----------------------------------------------------------
+   // Global projection variables
+   //-----------------------------------------------------------
+
+   double gAsp = 16.0 / 9.0; // Aspect ratio
+   double gDim = 2.0;        // Size of the world
+   int gPhi = 20;            // Elevation of view angle
+   int gTheta = 0;           // Azimuth of view angle
+
+   // Saved matrices / viewport for accurate gluUnProject (main view)
+   GLdouble gModelviewMain[16];
+   GLdouble gProjectionMainMatrix[16];
+   GLint gViewportMain[4];
+
+   //-----------------------------------------------------------
+   // Global lighting variables
+   //-----------------------------------------------------------
+   int gLight = 1;     // Lighting on or off
+   int gSmooth = 1;    // Smooth/Flat shading
+   int gMoveLight = 1; // Move light in idle or not
+
+   int gDistance = 2;       // Light distance
+   int gBallIncrement = 10; // Ball increment
+   int gEmission = 0;       // Emission intensity (%)
+   int gAmbient = 5;        // Ambient intensity (%)
+   int gDiffuse = 50;       // Diffuse intensity (%)
+   int gSpecular = 30;      // Specular intensity (%)
+   int gShininess = 0;      // Shininess (power of two)
+   double gShiny = 1;       // Shininess (value)
+   int gZeta = 160;         // Light azimuth
+   float gYLight = 1;       // Elevation of light
+
+   //-----------------------------------------------------------
+   // Global texture variables
+   //-----------------------------------------------------------
+   uint gTexture[1]; //  Texture names
+   uint gScroll = 0; // Texture scrolling in idle
+
+   //-----------------------------------------------------------
+   // Global mouse variables
+   //-----------------------------------------------------------
+
+   int gMouseX = 0, gMouseY = 0; // Current mouse position
+   int gMouseCaptured = 0;       // Whether mouse is captured for camera control
+
+   //-----------------------------------------------------------
+   // Global LS variables
+   //-----------------------------------------------------------
+   int gSpatialDim = 2;                        // Spatial dimension (2D/3D)
+   int gAxes = 1;                              // Display axes or not
+   double gXLB = -1.0;                         // x lower bound
+   double gXUB = 1.0;                          // x upper bound
+   double gZLB = -1.0;                         // z lower bound
+   double gZUB = 1.0;                          // z upper bound
+   double gScaleX = 1.0;                       // Scale factor for zooming
+   double gScaleZ = 1.0;                       // Scale factor for zooming
+   double gZ = 0.0;                            // Current z-slice
+   std::vector<LS> gLevelSets(MAX_GEOMETRIES); // Vector of level-set functions
+   std::atomic<uint> gNextLSId{1};             // Id of the next parsed level-set function
+   uint gActiveGeometry = MORIS_UINT_MAX;      // Currently active geometry for user input
+   uint gNumGeoms = 0;                         // Number of geometries defined
+
+   std::vector<double> gXVals(NUM_POINTS); // X values for grid
+   std::vector<double> gZVals(NUM_POINTS); // Z values for grid
+
+   std::mutex gLevelSetMutex; // Mutex to protect level-set updates from background input threads, held by the render path
+
+   bool gIsocontour = true;             // Flag to plot isocontour points
+   bool gRefinedOverlay = false;        // Flag to draw the quadtree interfaces over the projection
+   int gQuadtreeDepth = QUADTREE_DEPTH; // Finest level of the overlay quadtree
+
+   //-----------------------------------------------------------
+   // Global phase variables
+   //-----------------------------------------------------------
+
+   // Phase table: initialize with values 0,1,2,...,(2^MAX_GEOMETRIES)-1
+   std::vector<int> gPhaseTable = []()
+   {
+      int n = 1 << MAX_GEOMETRIES; // 2^MAX_GEOMETRIES
+      std::vector<int> v(n);
+      std::iota(v.begin(), v.end(), 0);
+      return v;
+   }();
+   std::vector<PHASE> gGeomsPhaseToPlot(MAX_GEOMETRIES, PHASE::NONE); // 0 = don't plot, 1 = plot positive, -1 = plot negative, 2 = plot both
+   std::vector<int> gPhasesToPlot = gPhaseTable;                      // Phases to plot
+
+   // Colors for each geometry (Paraview KAAMS color scheme)
+   std::vector<std::vector<double>> gColors = {
+       {1.0, 1.0, 1.0},
+       {1.0, 0.0, 0.0},
+       {0.0, 1.0, 0.0},
+       {0.0, 0.0, 1.0},
+       {1.0, 1.0, 0.0},
+       {0.0, 1.0, 1.0},
+       {1.0, 0.0, 1.0},
+       {0.5, 0.5, 0.5},
+       {1.0, 0.5, 0.0},
+       {0.5, 0.0, 0.5}};
+
+   uint gSelectedBitset = MORIS_UINT_MAX; // Currently selected bitset (gets a texture). MORIS_UINT_MAX means none selected
+
+   // Mutex to protect updates to the phase table when using a background input thread
+   std::mutex gPhaseTableMutex;
+
+   //-----------------------------------------------------------
+   // Global cache variables
+   //-----------------------------------------------------------
+
+   std::vector<Field> gFieldCache(FIELD_CACHE_SIZE); // Sampled level-set fields, reused until their key changes
+   uint gFieldVersion = 0;                           // Incremented every time a field is evaluated
+   uint gFrame = 0;                                  // Frame counter for least-recently-used eviction of fields
+   std::vector<std::pair<std::vector<std::string>, std::shared_ptr<const LSProgram>>> gScenePrograms; // Shared bytecode of recent level-set groups
+
+   std::vector<LS> gLSCache; // Recently parsed level-set functions, the most recently used last
+   std::mutex gLSCacheMutex; // Mutex to protect the level-set cache, which is used by the input threads
+
+   std::vector<SurfaceMesh> gSurfaceMeshes(MAX_GEOMETRIES); // Level-set plotter surfaces, rebuilt when their field changes
+
+   // Volumes and isosurfaces of the 3-D view
+   std::vector<VolumeField> gVolumeCache(VOLUME_CACHE_SIZE);     // Sampled volumes, reused until their key changes
+   std::vector<VolumeSurface> gVolumeSurfaces(MAX_GEOMETRIES);   // Isosurfaces, extracted again when their volume changes
+   std::vector<uint> gVolumeVersions;                            // Volume versions the isosurfaces were clipped with
+   std::vector<uint> gVolumeGenerations;                         // Scene generations of the inputs of the volumes
+
+   // Phase classification of the projection grid, rebuilt when a field changes
+   std::vector<Bitset> gBitsetGrid;                              // Bitset of every grid vertex, indexed [x][z]
+   std::vector<uint> gClassifiedVersions;                        // Field versions the bitset grid was classified from
+   std::vector<PolygonMesh> gPhasePolygons(1 << MAX_GEOMETRIES); // Polygons covering every bitset, clipped at the interfaces
+   std::vector<InterfaceCurves> gInterfaces(MAX_GEOMETRIES);     // Interface polylines of every geometry
+   std::vector<RefinedInterface> gRefinedShown(MAX_GEOMETRIES);  // Quadtree interfaces of the overlay, the last ones refined
+   size_t gRefinedSamples = 0;                                   // Level-set evaluations the quadtrees of gRefinedShown took
+   double gRefinedMilliseconds = 0.0;                            // Time their refinements took
+   bool gRefinedPending = false;                                 // Set while the overlay waits for an interface
+   bool gInterfacesIsocontour = true;                            // Isocontour flag the interfaces were extracted with
+   bool gInterfacesValid = false;                                // False when the interfaces must be extracted again
+   std::vector<const Field *> gInterfacesFields;                 // Fields the bitset grid was classified from
+   std::vector<uint> gInterfacesGenerations;                     // Scene generations of the inputs of the fields and interfaces
+   std::vector<bool> gVisibleBitsets;                            // Whether each bitset belongs to a phase to plot
+   std::vector<uint> gVisibleGenerations;                        // Scene generations gVisibleBitsets was computed for
+
+   //-----------------------------------------------------------
+   // Global viewport variables
+   //-----------------------------------------------------------
+
+   bool gProjectionMain = true; // Flag to change main viewport to projection view
+   int gWidth = 1920 / RES;     // Main window width
+   int gHeight = 1080 / RES;    // Main window height
+
+   int gProjWidth = 0.3 * gWidth;   // Projection viewport width
+   int gProjHeight = 0.3 * gHeight; // Projection viewport height
+   float gProjY = 0.0f;             // Projection viewport Y position
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Fills a vector with linearly spaced values between start and end.
+    * The vector must be pre-sized to the desired number of points
+    */
+   void linspace(std::vector<double> &aVec, double start, double end)
+   {
+      uint num = aVec.size();
+      double step = (end - start) / (num - 1);
+      for (uint i = 0; i < num; i++)
+      {
+         aVec[i] = start + i * step;
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   // Evaluate level-set function at given coordinates, using the calling thread's evaluation context
+   double eval_LS(const LS &aLS, double aX, double aY, double aZ = 0.0f)
+   {
+      if (aLS.empty())
+      {
+         return std::numeric_limits<double>::quiet_NaN();
+      }
+
+      // Evaluate expression
+#ifdef JIT
+      if (aLS.native() && aLS.native()->batch())
+      {
+         double tPhi;
+         aLS.native()->batch()(&aX, &aY, &aZ, &tPhi, 1);
+         return tPhi;
+      }
+#endif
+      if (aLS.program())
+      {
+         double tPhi;
+         aLS.program()->eval_batch(&aX, &aY, &aZ, &tPhi, 1);
+         return tPhi;
+      }
+      return aLS.context().eval(aX, aY, aZ);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Evaluates a level-set function at aCount points given as coordinate arrays
+    */
+   void eval_LS_batch(const LS &aLS, const double *aX, const double *aY, const double *aZ, double *aPhi, size_t aCount)
+   {
+      if (aLS.empty())
+      {
+         std::fill(aPhi, aPhi + aCount, std::numeric_limits<double>::quiet_NaN());
+         return;
+      }
+
+#ifdef JIT
+      if (aLS.native() && aLS.native()->batch())
+      {
+         aLS.native()->batch()(aX, aY, aZ, aPhi, aCount);
+         return;
+      }
+#endif
+      if (aLS.program())
+      {
+         aLS.program()->eval_batch(aX, aY, aZ, aPhi, aCount);
+      }
+      else
+      {
+         aLS.context().eval_batch(aX, aY, aZ, aPhi, aCount);
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Evaluates a level-set function on the tensor grid aXs x aYs at a fixed z.
+    * aPhi must hold aNumX * aNumY values and is indexed [x][y]
+    */
+   void eval_LS_grid(const LS &aLS, const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ, double *aPhi)
+   {
+      if (aLS.empty())
+      {
+         std::fill(aPhi, aPhi + aNumX * aNumY, std::numeric_limits<double>::quiet_NaN());
+         return;
+      }
+
+#ifdef JIT
+      // A separable program only evaluates every row and column once, which beats the native kernel
+      if (aLS.native() && aLS.native()->grid() && !aLS.program()->separable())
+      {
+         aLS.native()->grid()(aXs, aNumX, aYs, aNumY, aZ, aPhi);
+         return;
+      }
+#endif
+      if (aLS.program())
+      {
+         aLS.program()->eval_grid(aXs, aNumX, aYs, aNumY, aZ, aPhi);
+      }
+      else
+      {
+         aLS.context().eval_grid(aXs, aNumX, aYs, aNumY, aZ, aPhi);
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Evaluates a level-set function and its gradient at aCount points. The bytecode differentiates in the same pass,
+    * expressions only exprtk can evaluate fall back to central differences.
+    * aGradient receives the planes dphi/dx, dphi/dy and dphi/dz, aGradientStride apart
+    */
+   void eval_LS_gradient_batch(const LS &aLS, const double *aX, const double *aY, const double *aZ, double *aPhi, double *aGradient,
+                               size_t aGradientStride, size_t aCount)
+   {
+      if (aLS.program())
+      {
+         aLS.program()->eval_batch_gradient(aX, aY, aZ, aPhi, aGradient, aGradientStride, aCount);
+         return;
+      }
+
+      eval_LS_batch(aLS, aX, aY, aZ, aPhi, aCount);
+
+      // finite difference epsilon
+      const double tEps = 1e-6;
+
+      // Six stencil points per point, +eps and -eps in every direction
+      std::vector<double> tX(6 * aCount), tY(6 * aCount), tZ(6 * aCount), tPhi(6 * aCount);
+      for (size_t iP = 0; iP < aCount; iP++)
+      {
+         for (uint iDim = 0; iDim < 3; iDim++)
+         {
+            for (uint iSide = 0; iSide < 2; iSide++)
+            {
+               size_t tPoint = 6 * iP + 2 * iDim + iSide;
+               double tShift = iSide == 0 ? tEps : -tEps;
+               tX[tPoint] = aX[iP] + (iDim == 0 ? tShift : 0.0);
+               tY[tPoint] = aY[iP] + (iDim == 1 ? tShift : 0.0);
+               tZ[tPoint] = aZ[iP] + (iDim == 2 ? tShift : 0.0);
+            }
+         }
+      }
+
+      eval_LS_batch(aLS, tX.data(), tY.data(), tZ.data(), tPhi.data(), tPhi.size());
+
+      for (size_t iP = 0; iP < aCount; iP++)
+      {
+         for (uint iDim = 0; iDim < 3; iDim++)
+         {
+            aGradient[iDim * aGradientStride + iP] = 0.5 * (tPhi[6 * iP + 2 * iDim] - tPhi[6 * iP + 2 * iDim + 1]) / tEps;
+         }
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Evaluates a level-set function and its gradient on the tensor grid aXs x aYs at a fixed z.
+    * aPhi is indexed [x][y], aGradient holds the planes dphi/dx, dphi/dy and dphi/dz indexed the same way, aGradientStride apart
+    */
+   void eval_LS_gradient_grid(const LS &aLS, const double *aXs, size_t aNumX, const double *aYs, size_t aNumY, double aZ, double *aPhi,
+                              double *aGradient, size_t aGradientStride)
+   {
+      if (aLS.program())
+      {
+         aLS.program()->eval_grid_gradient(aXs, aNumX, aYs, aNumY, aZ, aPhi, aGradient, aGradientStride);
+         return;
+      }
+
+      // Expand the grid for the finite difference fallback
+      std::vector<double> tX(aNumX * aNumY), tY(aNumX * aNumY), tZ(aNumX * aNumY, aZ);
+      for (size_t iX = 0; iX < aNumX; iX++)
+      {
+         for (size_t iY = 0; iY < aNumY; iY++)
+         {
+            tX[iX * aNumY + iY] = aXs[iX];
+            tY[iX * aNumY + iY] = aYs[iY];
+         }
+      }
+      eval_LS_gradient_batch(aLS, tX.data(), tY.data(), tZ.data(), aPhi, aGradient, aGradientStride, tX.size());
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Normalized plotter normal (dphi/dx, -1, dphi/dz) of the surface y = phi(x, z) from a level-set gradient.
+    * The plotter's z axis is the level-set's y
+    */
+   void plotter_normal(const double *aGradient, double *aNormal)
+   {
+      double nx = aGradient[0];
+      double ny = -1.0;
+      double nz = aGradient[1];
+      double len = std::sqrt(nx * nx + ny * ny + nz * nz);
+
+      aNormal[0] = nx / len;
+      aNormal[1] = ny / len;
+      aNormal[2] = nz / len;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Root solver work, counted while a frame builds its meshes
+    */
+   struct RootStats
+   {
+      uint mRoots = 0;       // Interface roots found
+      uint mEvaluations = 0; // Level-set evaluations spent on them
+      uint mOverBudget = 0;  // Roots that used up ROOT_BUDGET evaluations before reaching the tolerance
+   };
+
+   std::atomic<uint> gRootCount{0};      // Roots found in the current frame
+   std::atomic<uint> gRootEvaluations{0}; // Evaluations spent on them
+   std::atomic<uint> gRootOverBudget{0};  // Roots that used up their budget
+   RootStats gLastRootStats;              // Work of the last frame that found roots, shown in the status line
+
+   /**
+    * Moves the root counts of the frame that just ended to gLastRootStats if it found any roots, and resets them
+    */
+   void end_frame_root_stats()
+   {
+      uint tRoots = gRootCount.exchange(0);
+      uint tEvaluations = gRootEvaluations.exchange(0);
+      uint tOverBudget = gRootOverBudget.exchange(0);
+      if (tRoots > 0)
+      {
+         gLastRootStats = {tRoots, tEvaluations, tOverBudget};
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Finds the root of a level-set function on a grid edge along x (aAxis 0) or y (aAxis 1) of the z-slice aSlice, between the
+    * coordinates aXNeg and aXPos along the edge at the fixed coordinate aFixed across it, where phi(aXNeg) < 0 and phi(aXPos) >= 0.
+    * The bracket is seeded with the endpoint values, which are never evaluated again.
+    * When the gradient at the root is wanted, or an endpoint slope along the edge is known (not NaN), Newton steps on the
+    * analytic gradient are taken, with bisection whenever a step leaves the bracket. The first guess is a Newton step
+    * from the endpoint closer to the root, or the secant. Otherwise the Illinois method runs on values alone, which
+    * converges superlinearly at the cost of plain evaluations
+    *
+    * @param aGradient If given, receives the gradient at the returned root, which is then the last point evaluated
+    * @param aTolerance Distance along the edge the root is found to
+    * @param aBudget Maximum number of evaluations, the best estimate so far is returned when they are used up
+    */
+   double find_root(const LS &aLS, uint aAxis, double aXNeg, double aPhiNeg, double aSlopeNeg, double aXPos, double aPhiPos, double aSlopePos,
+                    double aFixed, double aSlice, double *aGradient = nullptr, double aTolerance = ROOT_TOLERANCE, uint aBudget = ROOT_BUDGET)
+   {
+      // Coordinates of the point evaluated, tPoint[aAxis] moves along the edge
+      double tPoint[2];
+      tPoint[1 - aAxis] = aFixed;
+
+      auto tInside = [&](double aX)
+      {
+         return aX > std::min(aXNeg, aXPos) && aX < std::max(aXNeg, aXPos);
+      };
+
+      uint tEvaluations = 0;
+      bool tConverged = false;
+      double tX;
+
+      if (aGradient || !std::isnan(aSlopeNeg) || !std::isnan(aSlopePos))
+      {
+         bool tFromNeg = std::abs(aPhiNeg) < std::abs(aPhiPos);
+         tX = tFromNeg ? aXNeg - aPhiNeg / aSlopeNeg : aXPos - aPhiPos / aSlopePos;
+         if (!tInside(tX))
+         {
+            tX = aXNeg - aPhiNeg * (aXPos - aXNeg) / (aPhiPos - aPhiNeg);
+         }
+         if (!tInside(tX))
+         {
+            tX = 0.5 * (aXNeg + aXPos);
+         }
+
+         double tPhi;
+         double tGradient[3] = {std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN(),
+                                std::numeric_limits<double>::quiet_NaN()};
+         while (tEvaluations < aBudget)
+         {
+            tPoint[aAxis] = tX;
+            eval_LS_gradient_batch(aLS, &tPoint[0], &tPoint[1], &aSlice, &tPhi, tGradient, 1, 1);
+            tEvaluations++;
+            if (tPhi == 0.0 || std::isnan(tPhi))
+            {
+               tConverged = tPhi == 0.0;
+               break;
+            }
+            (tPhi < 0 ? aXNeg : aXPos) = tX;
+
+            double tNext = tX - tPhi / tGradient[aAxis];
+            if (!tInside(tNext))
+            {
+               tNext = 0.5 * (aXNeg + aXPos);
+            }
+
+            // The last point evaluated is returned, so the gradient belongs to it
+            tConverged = std::abs(tNext - tX) < aTolerance || std::abs(aXPos - aXNeg) < aTolerance;
+            if (tConverged || tEvaluations == aBudget)
+            {
+               break;
+            }
+            tX = tNext;
+         }
+
+         if (aGradient)
+         {
+            std::copy(tGradient, tGradient + 3, aGradient);
+         }
+      }
+      else
+      {
+         // Illinois: false position, halving the value of an endpoint that is kept twice in a row
+         double tPhiNeg = aPhiNeg;
+         double tPhiPos = aPhiPos;
+         int tLastMoved = 0; // -1 when the negative endpoint moved last, 1 for the positive one
+         tX = aXNeg - tPhiNeg * (aXPos - aXNeg) / (tPhiPos - tPhiNeg);
+         tConverged = tPhiPos == 0.0; // The positive endpoint is the root
+         while (!tConverged && tEvaluations < aBudget)
+         {
+            if (!tInside(tX))
+            {
+               tX = 0.5 * (aXNeg + aXPos);
+            }
+
+            double tPhi;
+            tPoint[aAxis] = tX;
+            eval_LS_batch(aLS, &tPoint[0], &tPoint[1], &aSlice, &tPhi, 1);
+            tEvaluations++;
+            if (tPhi == 0.0 || std::isnan(tPhi))
+            {
+               tConverged = tPhi == 0.0;
+               break;
+            }
+
+            if (tPhi < 0)
+            {
+               aXNeg = tX;
+               tPhiNeg = tPhi;
+               tPhiPos *= tLastMoved == -1 ? 0.5 : 1.0;
+               tLastMoved = -1;
+            }
+            else
+            {
+               aXPos = tX;
+               tPhiPos = tPhi;
+               tPhiNeg *= tLastMoved == 1 ? 0.5 : 1.0;
+               tLastMoved = 1;
+            }
+
+            double tNext = aXNeg - tPhiNeg * (aXPos - aXNeg) / (tPhiPos - tPhiNeg);
+            tConverged = std::abs(tNext - tX) < aTolerance || std::abs(aXPos - aXNeg) < aTolerance;
+            tX = tNext;
+            if (tConverged)
+            {
+               break;
+            }
+         }
+      }
+
+      gRootCount.fetch_add(1, std::memory_order_relaxed);
+      gRootEvaluations.fetch_add(tEvaluations, std::memory_order_relaxed);
+      if (!tConverged)
+      {
+         gRootOverBudget.fetch_add(1, std::memory_order_relaxed);
+      }
+      return tX;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Index of a grid edge among all edges of a grid with aNumPoints points per side. The x-edges from vertex [i][j] to
+    * [i+1][j] (aAxis 0) come first, followed by the y-edges from [i][j] to [i][j+1] (aAxis 1)
+    */
+   inline size_t edge_index(uint aAxis, int i, int j, int aNumPoints)
+   {
+      return aAxis == 0 ? i * aNumPoints + j : (aNumPoints - 1) * aNumPoints + i * (aNumPoints - 1) + j;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Allocates the root storage of a field, every root unsolved. Roots of different edges can then be solved in parallel
+    */
+   void prepare_edge_roots(const Field &aField)
+   {
+      if (aField.mRoots.empty())
+      {
+         int tNumPoints = NUM_POINTS / aField.mKey.mStride;
+         aField.mRoots.assign(2 * (tNumPoints - 1) * tNumPoints, std::numeric_limits<double>::quiet_NaN());
+         aField.mRootGradients.assign(aField.mGradient.empty() ? 0 : 3 * aField.mRoots.size(), 0.0);
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Interface root of a field's level-set on the grid edge from vertex [i][j] to [i+1][j] (aAxis 0) or [i][j+1] (aAxis 1)
+    * of the field's grid, where the signs of phi differ. Roots are solved on first use and kept with the field until it is
+    * sampled again, so all meshes built from the field share one solve per edge, across bitsets, sign conditions and frames
+    *
+    * @param aGradient If given, receives the gradient at the root. aField must be sampled with gradients
+    * @return Coordinate of the root along the edge
+    */
+   double edge_root(const LS &aLS, const Field &aField, uint aAxis, int i, int j, double *aGradient = nullptr)
+   {
+      int tStride = aField.mKey.mStride;
+      int tNumPoints = NUM_POINTS / tStride;
+      int tNumVerts = tNumPoints * tNumPoints;
+      bool tHasGradient = !aField.mGradient.empty();
+      prepare_edge_roots(aField);
+
+      size_t tEdge = edge_index(aAxis, i, j, tNumPoints);
+      double &tRoot = aField.mRoots[tEdge];
+      double *tRootGradient = tHasGradient ? &aField.mRootGradients[3 * tEdge] : nullptr;
+      if (std::isnan(tRoot))
+      {
+         size_t tVert0 = i * tNumPoints + j;
+         size_t tVert1 = aAxis == 0 ? tVert0 + tNumPoints : tVert0 + 1;
+         double t0 = aAxis == 0 ? gXVals[i * tStride] : gZVals[j * tStride];
+         double t1 = aAxis == 0 ? gXVals[(i + 1) * tStride] : gZVals[(j + 1) * tStride];
+         double tFixed = aAxis == 0 ? gZVals[j * tStride] : gXVals[i * tStride];
+         double y0 = aField.mPhi[tVert0];
+         double y1 = aField.mPhi[tVert1];
+
+         // Slopes along the edge seed Newton when the field has them
+         const double tNoSlope = std::numeric_limits<double>::quiet_NaN();
+         double g0 = tHasGradient ? aField.mGradient[aAxis * tNumVerts + tVert0] : tNoSlope;
+         double g1 = tHasGradient ? aField.mGradient[aAxis * tNumVerts + tVert1] : tNoSlope;
+         double tSlice = aField.mKey.mSlice;
+         tRoot = y0 < 0 ? find_root(aLS, aAxis, t0, y0, g0, t1, y1, g1, tFixed, tSlice, tRootGradient)
+                        : find_root(aLS, aAxis, t1, y1, g1, t0, y0, g0, tFixed, tSlice, tRootGradient);
+      }
+
+      if (aGradient)
+      {
+         std::copy(tRootGradient, tRootGradient + 3, aGradient);
+      }
+      return tRoot;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Bit of a geometry in a bitset. Geometry 0 is the most significant of the aNumGeoms bits in use
+    */
+   inline Bitset geometry_bit(uint aGeom, uint aNumGeoms = gNumGeoms)
+   {
+      return static_cast<Bitset>(1u << (aNumGeoms - 1 - aGeom));
+   }
+
+   //-----------------------------------------------------------------------
+
+   /*
+    * Gets the indices of the phase table that correspond to a given phase
+    */
+   std::vector<int> get_indices_for_phase(int aPhase)
+   {
+      std::vector<int> indices;
+      for (size_t i = 0; i < gPhaseTable.size(); i++)
+      {
+         if (gPhaseTable[i] == aPhase)
+         {
+            indices.push_back(i);
+         }
+      }
+      return indices;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Resets all active geometry phases to NONE
+    */
+   void reset_active_phases()
+   {
+      for (uint iG = 0; iG < MAX_GEOMETRIES; iG++)
+      {
+         gGeomsPhaseToPlot[iG] = PHASE::NONE;
+      }
+      gScene.touch(SCENE::PHASES);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Adds geometry phases to plot from binary representation
+    * If bit is 1, plot positive phase; if bit is 0, plot negative phase
+    * Ex. If positive phase is already active but the binary indicates negative phase, it will then plot both pos and neg phases
+    */
+   void append_active_phases_from_bitset(Bitset aBitset)
+   {
+      for (uint iG = 0; iG < gNumGeoms; iG++)
+      {
+         if (aBitset & geometry_bit(iG))
+         {
+            // Set to plot positive phase
+            if (gGeomsPhaseToPlot[iG] == PHASE::NONE)
+            {
+               gGeomsPhaseToPlot[iG] = PHASE::POSITIVE;
+            }
+            else if (gGeomsPhaseToPlot[iG] == PHASE::NEGATIVE)
+            {
+               gGeomsPhaseToPlot[iG] = PHASE::ALL;
+            }
+         }
+         else
+         {
+            // Set to plot negative phase
+            if (gGeomsPhaseToPlot[iG] == PHASE::NONE)
+            {
+               gGeomsPhaseToPlot[iG] = PHASE::NEGATIVE;
+            }
+            else if (gGeomsPhaseToPlot[iG] == PHASE::POSITIVE)
+            {
+               gGeomsPhaseToPlot[iG] = PHASE::ALL;
+            }
+         }
+      }
+      gScene.touch(SCENE::PHASES);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Gets all the bitsets from the phase table that are assigned to a given phase index,
+    * then sets the active geometry phases to plot accordingly
+    */
+   void set_active_phases_from_phase_index(int aIndex)
+   {
+      // Reset active phases
+      reset_active_phases();
+
+      // Get all the bitset indices for the given phase
+      std::vector<int> tIndices = get_indices_for_phase(aIndex);
+
+      // Loop through the bitsets and convert to binary to set active regions for each geometry
+      for (int iIndex : tIndices)
+      {
+         append_active_phases_from_bitset(iIndex); // Add the geometry signs of this bitset to the active phases
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Function to see the negative region for all currently active geometries
+    */
+   void set_all_active_phases_to_negative()
+   {
+      for (uint iG = 0; iG < MAX_GEOMETRIES; iG++)
+      {
+         if (gGeomsPhaseToPlot[iG] != PHASE::NONE)
+         {
+            gGeomsPhaseToPlot[iG] = PHASE::NEGATIVE;
+         }
+      }
+      gScene.touch(SCENE::PHASES);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Function to see the positive region for all currently active geometries
+    */
+   void set_all_active_phases_to_positive()
+   {
+      for (uint iG = 0; iG < MAX_GEOMETRIES; iG++)
+      {
+         if (gGeomsPhaseToPlot[iG] != PHASE::NONE)
+         {
+            gGeomsPhaseToPlot[iG] = PHASE::POSITIVE;
+         }
+      }
+      gScene.touch(SCENE::PHASES);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /*
+    *  Draw vertex in polar coordinates with normal
+    */
+   static void Vertex(double th, double ph)
+   {
+      double x = Sin(th) * Cos(ph);
+      double y = Cos(th) * Cos(ph);
+      double z = Sin(ph);
+      //  For a sphere at the origin, the position
+      //  and normal vectors are the same
+      glNormal3d(x, y, z);
+      glVertex3d(x, y, z);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /*
+    *  Draw a ball
+    *     at (x,y,z)
+    *     radius (r)
+    */
+   static void ball(double x, double y, double z, double r)
+   {
+      //  Save transformation
+      glPushMatrix();
+      //  Offset, scale and rotate
+      glTranslated(x, y, z);
+      glScaled(r, r, r);
+      //  White ball with yellow specular
+      float yellow[] = {1.0, 1.0, 0.0, 1.0};
+      float Emission[] = {0.0, 0.0, (float)0.01 * gEmission, 1.0};
+      glColor3f(1, 1, 1);
+      glMaterialf(GL_FRONT, GL_SHININESS, gShiny);
+      glMaterialfv(GL_FRONT, GL_SPECULAR, yellow);
+      glMaterialfv(GL_FRONT, GL_EMISSION, Emission);
+      //  Bands of latitude
+      for (int ph = -90; ph < 90; ph += gBallIncrement)
+      {
+         glBegin(GL_QUAD_STRIP);
+         for (int th = 0; th <= 360; th += 2 * gBallIncrement)
+         {
+            Vertex(th, ph);
+            Vertex(th, ph + gBallIncrement);
+         }
+         glEnd();
+      }
+      //  Undo transofrmations
+      glPopMatrix();
+   }
+
+   //-----------------------------------------------------------------------
+
+   // Helper to trim whitespace from start and end of a string
+   std::string trim(const std::string &s)
+   {
+      size_t start = s.find_first_not_of(" \t\n\r");
+      if (start == std::string::npos)
+         return "";
+      size_t end = s.find_last_not_of(" \t\n\r");
+      return s.substr(start, end - start + 1);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Gets an entire phase table from user input
+    */
+   void get_phase_table_user_input()
+   {
+      // Read a full line from console
+      std::string tInput;
+      std::cout << "Enter phase numbers for each geometry (comma or space separated): ";
+      std::getline(std::cin, tInput);
+
+      // Normalize delimiters: replace commas with spaces so we can use >> extraction
+      for (char &c : tInput)
+      {
+         if (c == ',')
+            c = ' ';
+      }
+
+      // Parse into a local temporary table to avoid holding the mutex during I/O
+      std::stringstream ss(tInput);
+      std::string token;
+      size_t tPhase = 0;
+      std::vector<int> tTemp(gPhaseTable.size(), -1);
+
+      while (ss >> token)
+      {
+         token = trim(token); // remove surrounding whitespace
+         if (token.empty())
+            continue;
+         if (tPhase >= tTemp.size())
+            break; // ignore extra values
+         try
+         {
+            tTemp[tPhase] = static_cast<int>(std::stoul(token));
+         }
+         catch (const std::exception &)
+         {
+            // Invalid token: leave as invalid phase and continue
+            tTemp[tPhase] = -1;
+         }
+         ++tPhase;
+      }
+
+      // Expected number of phases depends on number of geometries
+      size_t tExpected = (gNumGeoms >= 0 && gNumGeoms < (8 * sizeof(uint))) ? (1u << gNumGeoms) : 0u;
+
+      if (tPhase != tExpected)
+      {
+         std::cout << "Incorrect number of phases entered. Expected " << tExpected << " but got " << tPhase << ". Try again\n";
+         get_phase_table_user_input();
+         return;
+      }
+
+      // Commit the parsed values into the shared phase table under the mutex
+      {
+         std::lock_guard<std::mutex> lock(gPhaseTableMutex);
+         // Reset to -1 first, then copy parsed values
+         std::fill(gPhaseTable.begin(), gPhaseTable.end(), -1);
+         for (size_t i = 0; i < tTemp.size(); ++i)
+         {
+            gPhaseTable[i] = tTemp[i];
+         }
+
+         // Plot all phases in the projection
+         uint tMaxPhase = *std::max_element(gPhaseTable.begin(), gPhaseTable.end());
+         gPhasesToPlot.resize(tMaxPhase + 1);
+         std::iota(gPhasesToPlot.begin(), gPhasesToPlot.end(), 0);
+      }
+      gScene.touch(SCENE::PHASES);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Compares compiled code against exprtk on a fixed set of points in [-2,2]^3.
+    * aEvalBatch is called like LSProgram::eval_batch
+    */
+   template <typename EvalBatch>
+   bool batch_matches_context(EvalBatch aEvalBatch, LSContext &aContext)
+   {
+      const size_t tNumSamples = 64;
+      std::vector<double> tX(tNumSamples), tY(tNumSamples), tZ(tNumSamples), tPhi(tNumSamples);
+
+      // Deterministic pseudo-random points
+      uint tState = 12345;
+      auto tRandom = [&tState]()
+      {
+         tState = tState * 1664525u + 1013904223u;
+         return 4.0 * (tState >> 8) / double(1u << 24) - 2.0;
+      };
+      for (size_t iP = 0; iP < tNumSamples; iP++)
+      {
+         tX[iP] = tRandom();
+         tY[iP] = tRandom();
+         tZ[iP] = tRandom();
+      }
+
+      aEvalBatch(tX.data(), tY.data(), tZ.data(), tPhi.data(), tNumSamples);
+
+      for (size_t iP = 0; iP < tNumSamples; iP++)
+      {
+         double tExpected = aContext.eval(tX[iP], tY[iP], tZ[iP]);
+         if (std::isnan(tExpected) || std::isnan(tPhi[iP]))
+         {
+            if (std::isnan(tExpected) != std::isnan(tPhi[iP]))
+               return false;
+         }
+         else if (tExpected != tPhi[iP] && !(std::abs(tExpected - tPhi[iP]) <= 1e-9 * std::max(1.0, std::abs(tExpected))))
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   //-----------------------------------------------------------------------
+
+#if defined(JIT) || defined(DISK_CACHE)
+   /**
+    * Directory of the on-disk caches, $XDG_CACHE_HOME or ~/.cache
+    */
+   std::filesystem::path cache_directory()
+   {
+      std::filesystem::path tBase;
+      if (const char *tCache = std::getenv("XDG_CACHE_HOME"))
+      {
+         tBase = tCache;
+      }
+      else if (const char *tHome = std::getenv("HOME"))
+      {
+         tBase = std::filesystem::path(tHome) / ".cache";
+      }
+      else
+      {
+         tBase = std::filesystem::temp_directory_path();
+      }
+      return tBase;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * 64-bit FNV-1a hash as hex digits, stable between runs so it can name cache files
+    */
+   std::string stable_hash(const std::string &aText)
+   {
+      uint64_t tHash = 14695981039346656037ull;
+      for (char c : aText)
+      {
+         tHash = (tHash ^ (unsigned char)c) * 1099511628211ull;
+      }
+      std::ostringstream tHex;
+      tHex << std::hex << tHash;
+      return tHex.str();
+   }
+#endif
+
+   //-----------------------------------------------------------------------
+
+#ifdef JIT
+   /**
+    * Directory of the compiled kernel cache
+    */
+   std::filesystem::path native_cache_directory()
+   {
+      return cache_directory() / "moris_gui_jit";
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Gets the native kernel of a level-set's bytecode. A kernel found in the on-disk cache, keyed by a hash of the
+    * generated source and the compiler command, is loaded right away. Otherwise the kernel is compiled on a
+    * background thread and filled in when ready; the kernel stays empty if the compile or the check against exprtk fails
+    */
+   std::shared_ptr<const NativeKernel> compile_native(const std::string &aSource, const LSProgram &aProgram)
+   {
+      std::string tCode = aProgram.native_source();
+      std::string tCommand = JIT_COMPILER;
+
+      std::string tName = "ls_" + stable_hash(tCode + tCommand + JIT_LIBS);
+
+      std::filesystem::path tDirectory = native_cache_directory();
+      std::filesystem::path tLibrary = tDirectory / (tName + ".so");
+
+      auto tKernel = std::make_shared<NativeKernel>();
+      auto tCheck = [aSource](NativeKernel::BatchFunction aBatch)
+      {
+         LSContext tContext(aSource);
+         return batch_matches_context(aBatch, tContext);
+      };
+
+      std::error_code tError;
+      if (std::filesystem::exists(tLibrary, tError) && tKernel->load(tLibrary.string(), tCheck))
+      {
+         return tKernel;
+      }
+
+      std::thread([=]()
+                  {
+         // Build under a unique name and rename, so concurrent compiles of the same kernel don't collide
+         std::error_code tError;
+         std::filesystem::create_directories(tDirectory, tError);
+         std::string tUnique = tName + "." + std::to_string(getpid()) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+         std::filesystem::path tCpp = tDirectory / (tUnique + ".cpp");
+         std::filesystem::path tTemporary = tDirectory / (tUnique + ".so");
+
+         std::ofstream(tCpp) << tCode;
+         std::string tBuild = tCommand + " -o '" + tTemporary.string() + "' '" + tCpp.string() + "' " + JIT_LIBS + " 2>/dev/null";
+         bool tBuilt = std::system(tBuild.c_str()) == 0;
+         std::filesystem::remove(tCpp, tError);
+         if (tBuilt)
+         {
+            std::filesystem::rename(tTemporary, tLibrary, tError);
+            tBuilt = !tError;
+         }
+
+         if (!tBuilt || !tKernel->load(tLibrary.string(), tCheck))
+         {
+            std::filesystem::remove(tTemporary, tError);
+            std::cout << "Native compile failed for " << aSource << ", using the bytecode\n";
+         } })
+          .detach();
+
+      return tKernel;
+   }
+
+   //-----------------------------------------------------------------------
+#endif
+
+   /**
+    * Removes the whitespace of an expression that doesn't separate two names or numbers, so expressions
+    * that only differ in spacing have the same source
+    */
+   std::string normalize_source(const std::string &aInput)
+   {
+      auto tIsWord = [](char c)
+      {
+         return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+      };
+
+      std::string tSource;
+      bool tSpace = false;
+      for (char c : aInput)
+      {
+         if (std::isspace(static_cast<unsigned char>(c)))
+         {
+            tSpace = true;
+            continue;
+         }
+         if (tSpace && !tSource.empty() && tIsWord(tSource.back()) && tIsWord(c))
+         {
+            tSource += ' ';
+         }
+         tSource += c;
+         tSpace = false;
+      }
+      return tSource;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Looks up a parsed level-set function in the level-set cache and marks it as the most recently used
+    */
+   bool find_cached_LS(const std::string &aSource, LS &aLS)
+   {
+      std::lock_guard<std::mutex> lock(gLSCacheMutex);
+      auto tFound = std::find_if(gLSCache.begin(), gLSCache.end(), [&aSource](const LS &tLS)
+                                 { return tLS.source() == aSource; });
+      if (tFound == gLSCache.end())
+      {
+         return false;
+      }
+      std::rotate(tFound, tFound + 1, gLSCache.end());
+      aLS = gLSCache.back();
+      return true;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Uses exprtk to parse a level-set function from a string.
+    * Parsed level-sets are kept in a least-recently-used cache keyed by their whitespace-normalized source,
+    * so loading an expression again reuses its id, evaluation contexts, bytecode and native kernel
+    * @param aInput String containing the level-set function expression (must be of x,y,z)
+    */
+   LS load_LS_from_string(std::string aInput)
+   {
+      std::string tSource = normalize_source(aInput);
+      LS tCached;
+      if (find_cached_LS(tSource, tCached))
+      {
+         return tCached;
+      }
+
+      uint tId = gNextLSId++;
+      std::shared_ptr<const void> tOwner = std::make_shared<char>();
+
+      // Parse the user input, the compiled context is kept for the calling thread
+      std::unique_ptr<LSContext> &tContext = thread_context(tId, tOwner);
+      tContext = std::make_unique<LSContext>(tSource);
+
+      // Lower to bytecode, which is only used if it agrees with exprtk
+      std::shared_ptr<const LSProgram> tProgram = LSProgram::compile(tSource);
+      auto tEvalProgram = [&tProgram](auto... aArgs)
+      {
+         tProgram->eval_batch(aArgs...);
+      };
+      if (tProgram && !batch_matches_context(tEvalProgram, *tContext))
+      {
+         tProgram = nullptr;
+      }
+
+      LS tLS(tSource, tId, tOwner, tProgram, tContext->parameters());
+#ifdef JIT
+      if (tProgram)
+      {
+         tLS.set_native(compile_native(tSource, *tProgram));
+      }
+#endif
+
+      // Another thread may have parsed the same expression in the meantime, keep the first one
+      if (find_cached_LS(tSource, tCached))
+      {
+         return tCached;
+      }
+      std::lock_guard<std::mutex> lock(gLSCacheMutex);
+      if (gLSCache.size() == LS_CACHE_SIZE)
+      {
+         gLSCache.erase(gLSCache.begin());
+      }
+      gLSCache.push_back(tLS);
+      return tLS;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Gets level-set function input from the user without blocking the main thread.
+    *
+    * @param aGeometryIndex Index of the geometry to update
+    */
+   void request_LS_input_async(uint aGeometryIndex)
+   {
+      // Detach thread: it owns its lifetime and will signal redisplay on completion.
+      std::thread([aGeometryIndex]()
+                  {
+        std::string tInput;
+        std::cout << ("Enter a level-set function of (x,y,z):");
+        if (!std::getline(std::cin, tInput))
+        {
+           std::cerr << "Input aborted or EOF encountered.\n";
+           return;
+        }
+
+        tInput = trim(tInput);
+        if (tInput.empty())
+        {
+           std::cerr << "Empty input - ignoring.\n";
+           return;
+        }
+
+        try
+        {
+           // Parse and compile expression (keeps same semantics as synchronous helper)
+           LS tExpr = load_LS_from_string(tInput);
+
+           // Commit into shared state
+           {
+              std::lock_guard<std::mutex> lock(gLevelSetMutex);
+              if (aGeometryIndex < gLevelSets.size())
+              {
+                 gLevelSets[aGeometryIndex] = tExpr;
+                 gGeomsPhaseToPlot[aGeometryIndex] = PHASE::ALL;
+                 gScene.touch(SCENE::GEOMETRY);
+                 gScene.touch(SCENE::PHASES);
+              }
+           }
+        }
+        catch (const std::exception &e)
+        {
+           // Parse failures, including unknown names that can't be parameters, leave the geometry unchanged
+           std::cerr << e.what() << "\n";
+        } })
+          .detach();
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Whether a name can be used for a parameter, which excludes the coordinates, the exprtk constants and reserved words
+    */
+   bool is_parameter_name(const std::string &aName)
+   {
+      if (aName.empty() || !std::isalpha(static_cast<unsigned char>(aName[0])) ||
+          !std::all_of(aName.begin(), aName.end(), [](unsigned char c)
+                       { return std::isalnum(c) || c == '_'; }))
+      {
+         return false;
+      }
+
+      double tValue = 0.0;
+      exprtk::symbol_table<double> tSymbolTable;
+      tSymbolTable.add_constants();
+      for (const char *tCoordinate : {"x", "y", "z"})
+      {
+         tSymbolTable.add_variable(tCoordinate, tValue);
+      }
+      return tSymbolTable.add_variable(aName, tValue);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Gets a parameter assignment "name = value" from the user without blocking the main thread.
+    * The parameter becomes the active one, and is registered if it doesn't exist yet
+    */
+   void request_parameter_input_async()
+   {
+      std::thread([]()
+                  {
+        std::string tInput;
+        std::cout << "Enter a parameter as name = value:";
+        if (!std::getline(std::cin, tInput))
+        {
+           std::cerr << "Input aborted or EOF encountered.\n";
+           return;
+        }
+
+        size_t tEquals = tInput.find('=');
+        std::string tName = trim(tInput.substr(0, tEquals));
+        if (tEquals == std::string::npos || !is_parameter_name(tName))
+        {
+           std::cerr << "Expected name = value with a name that isn't a coordinate or function - ignoring.\n";
+           return;
+        }
+
+        double tValue;
+        try
+        {
+           tValue = std::stod(tInput.substr(tEquals + 1));
+        }
+        catch (const std::exception &)
+        {
+           std::cerr << "Failed to parse the parameter value.\n";
+           return;
+        }
+
+        // Fields that use the parameter see the new value in their cache key and are sampled again
+        std::lock_guard<std::mutex> lock(gLevelSetMutex);
+        std::lock_guard<std::mutex> tValuesLock(gParameterValuesMutex);
+        uint tIndex = add_parameter(tName);
+        if (tIndex == MORIS_UINT_MAX)
+        {
+           std::cerr << "Maximum number of parameters reached.\n";
+           return;
+        }
+        gParameterValues[tIndex] = tValue;
+        gActiveParameter = tIndex;
+        gScene.touch(SCENE::PARAMETERS);
+        std::cout << gParameterNames[tIndex] << " = " << tValue << ", change it with [ and ]\n"; })
+          .detach();
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Steps the active parameter by aSteps times PARAMETER_STEP of the domain width
+    */
+   void step_parameter(double aSteps)
+   {
+      if (gActiveParameter == MORIS_UINT_MAX)
+      {
+         if (gNumParameters == 0)
+         {
+            std::cout << "No parameters, set one with k" << std::endl;
+            return;
+         }
+         gActiveParameter = 0;
+      }
+
+      std::lock_guard<std::mutex> lock(gLevelSetMutex);
+      std::lock_guard<std::mutex> tValuesLock(gParameterValuesMutex);
+      gParameterValues[gActiveParameter] += aSteps * PARAMETER_STEP * (gXUB - gXLB);
+      gScene.touch(SCENE::PARAMETERS);
+      std::cout << gParameterNames[gActiveParameter] << " = " << gParameterValues[gActiveParameter] << std::endl;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Prompts the user to enter a phase index for a given bitset and updates the phase table accordingly.
+    *
+    * @param aBitset Bitset to update, it is its own index in the phase table
+    */
+   void prompt_and_update_phase(Bitset aBitset)
+   {
+      // Print prompt showing bitset as +/-
+      std::cout << "Enter a phase for the current bitset (";
+      for (uint iG = 0; iG < gNumGeoms; ++iG)
+      {
+         std::cout << (aBitset & geometry_bit(iG) ? "+" : "-");
+         if (iG + 1 < gNumGeoms)
+            std::cout << ",";
+      }
+      std::cout << "): ";
+
+      // Read input
+      std::string tInput;
+      std::getline(std::cin, tInput);
+
+      // Convert string input to integer if valid
+      int tPhaseValue = 0;
+      try
+      {
+         tInput = trim(tInput);
+         if (!tInput.empty())
+            tPhaseValue = std::stoi(tInput);
+      }
+      catch (const std::exception &)
+      {
+         std::cerr << "Invalid phase input - ignoring.\n";
+         return;
+      }
+
+      // Update shared phase table
+      {
+         std::lock_guard<std::mutex> lock(gPhaseTableMutex);
+         // check that the given phase index is appropriate for the number of geometries
+         if (tPhaseValue > 0 and tPhaseValue < (1 << gNumGeoms) - 1)
+         {
+
+            gPhaseTable[aBitset] = tPhaseValue;
+
+            // Ensure the phase is in the list to plot
+            if (std::find(gPhasesToPlot.begin(), gPhasesToPlot.end(), tPhaseValue) == gPhasesToPlot.end())
+            {
+               gPhasesToPlot.push_back(tPhaseValue);
+            }
+
+            // Clear selection
+            gSelectedBitset = MORIS_UINT_MAX;
+            gScene.touch(SCENE::PHASES);
+         }
+         else
+         {
+            // Reject input - print message
+            std::cout << "Invalid phase value entered.\n";
+         }
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Coordinates of rows [aRowBegin, aRowEnd) and of every column of the aStride-th points of the grid
+    */
+   void sample_coordinates(int aStride, int aRowBegin, int aRowEnd, std::vector<double> &aXs, std::vector<double> &aZs)
+   {
+      int tNumPoints = NUM_POINTS / aStride;
+      aXs.resize(aRowEnd - aRowBegin);
+      aZs.resize(tNumPoints);
+      for (int iX = aRowBegin; iX < aRowEnd; iX++)
+      {
+         aXs[iX - aRowBegin] = gXVals[iX * aStride];
+      }
+      for (int iY = 0; iY < tNumPoints; iY++)
+      {
+         aZs[iY] = gZVals[iY * aStride];
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Where a range of points of a field is sampled to. Fields of doubles are written in place, float fields are
+    * sampled to scratch storage and narrowed into the field by store()
+    */
+   template <typename T>
+   struct SampleTarget
+   {
+      SampleTarget(FieldBuffer<T> &aPhi, FieldBuffer<T> &aGradient, size_t aOffset, size_t aCount)
+          : mFieldPhi(aPhi), mFieldGradient(aGradient), mOffset(aOffset), mCount(aCount)
+      {
+         if constexpr (std::is_same_v<T, double>)
+         {
+            mPhi = &aPhi[aOffset];
+            mGradient = aGradient.empty() ? nullptr : &aGradient[aOffset];
+            mGradientStride = aPhi.size();
+         }
+         else
+         {
+            mScratch.resize((aGradient.empty() ? 1 : 4) * aCount);
+            mPhi = mScratch.data();
+            mGradient = aGradient.empty() ? nullptr : mPhi + aCount;
+            mGradientStride = aCount;
+         }
+      }
+
+      void store()
+      {
+         if constexpr (!std::is_same_v<T, double>)
+         {
+            std::copy(mPhi, mPhi + mCount, &mFieldPhi[mOffset]);
+            for (uint iDim = 0; mGradient && iDim < 3; iDim++)
+            {
+               std::copy(mGradient + iDim * mCount, mGradient + (iDim + 1) * mCount, &mFieldGradient[iDim * mFieldPhi.size() + mOffset]);
+            }
+         }
+      }
+
+      double *mPhi;           // Where the values are sampled to
+      double *mGradient;      // Where the gradient planes are sampled to, nullptr without gradients
+      size_t mGradientStride; // Distance between the gradient planes
+
+    private:
+      FieldBuffer<T> &mFieldPhi;
+      FieldBuffer<T> &mFieldGradient;
+      size_t mOffset;
+      size_t mCount;
+      std::vector<double> mScratch;
+   };
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Samples a level-set function on rows [aRowBegin, aRowEnd) of every aStride-th point of the grid at the z-slice aSlice.
+    * aPhi must already be sized for the full field, as must aGradient unless it is empty
+    */
+   void sample_field_rows(const LS &aLS, int aStride, int aRowBegin, int aRowEnd, double aSlice, FieldBuffer<FieldValue> &aPhi,
+                          FieldBuffer<FieldValue> &aGradient)
+   {
+      int tNumPoints = NUM_POINTS / aStride;
+      std::vector<double> tXs, tZs;
+      sample_coordinates(aStride, aRowBegin, aRowEnd, tXs, tZs);
+
+      SampleTarget<FieldValue> tTarget(aPhi, aGradient, aRowBegin * tNumPoints, tXs.size() * tNumPoints);
+      if (!tTarget.mGradient)
+      {
+         eval_LS_grid(aLS, tXs.data(), tXs.size(), tZs.data(), tZs.size(), aSlice, tTarget.mPhi);
+      }
+      else
+      {
+         eval_LS_gradient_grid(aLS, tXs.data(), tXs.size(), tZs.data(), tZs.size(), aSlice, tTarget.mPhi, tTarget.mGradient,
+                               tTarget.mGradientStride);
+      }
+      tTarget.store();
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Samples several fields on rows [aRowBegin, aRowEnd) with one shared program that has an output per field
+    */
+   void sample_scene_rows(const LSProgram &aScene, const std::vector<Field *> &aFields, int aStride, int aRowBegin, int aRowEnd,
+                          double aSlice)
+   {
+      int tNumPoints = NUM_POINTS / aStride;
+      std::vector<double> tXs, tZs;
+      sample_coordinates(aStride, aRowBegin, aRowEnd, tXs, tZs);
+
+      std::vector<SampleTarget<FieldValue>> tTargets;
+      std::vector<double *> tPhis, tGradients;
+      tTargets.reserve(aFields.size());
+      for (Field *tField : aFields)
+      {
+         tTargets.emplace_back(tField->mPhi, tField->mGradient, aRowBegin * tNumPoints, tXs.size() * tNumPoints);
+         tPhis.push_back(tTargets.back().mPhi);
+         tGradients.push_back(tTargets.back().mGradient);
+      }
+
+      if (!tGradients[0])
+      {
+         aScene.eval_grid_outputs(tXs.data(), tXs.size(), tZs.data(), tZs.size(), aSlice, tPhis.data());
+      }
+      else
+      {
+         aScene.eval_grid_gradient_outputs(tXs.data(), tXs.size(), tZs.data(), tZs.size(), aSlice, tPhis.data(), tGradients.data(),
+                                           tTargets[0].mGradientStride);
+      }
+      for (SampleTarget<FieldValue> &tTarget : tTargets)
+      {
+         tTarget.store();
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Interval bounds of the tile of rows [aRowBegin, aRowEnd) and columns [aColumnBegin, aColumnEnd) of the aStride-th
+    * grid points, widened by one grid point on every side. With the wider bounds every grid cell with a sign change
+    * has all its corners in tiles that are evaluated point by point
+    */
+   Interval tile_bounds(const LS &aLS, int aStride, int aRowBegin, int aRowEnd, int aColumnBegin, int aColumnEnd, double aSlice)
+   {
+      int tNumPoints = NUM_POINTS / aStride;
+      auto tRange = [](double a, double b)
+      {
+         return Interval{std::min(a, b), std::max(a, b)};
+      };
+      Interval tXRange = tRange(gXVals[std::max(aRowBegin - 1, 0) * aStride], gXVals[std::min(aRowEnd, tNumPoints - 1) * aStride]);
+      Interval tZRange = tRange(gZVals[std::max(aColumnBegin - 1, 0) * aStride], gZVals[std::min(aColumnEnd, tNumPoints - 1) * aStride]);
+      return aLS.program()->eval_interval(tXRange, tZRange, {aSlice, aSlice});
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Fills a tile of a sign field with +-infinity if interval bounds prove the level-set strictly positive or negative on it.
+    * Returns whether the tile was filled
+    */
+   bool prune_tile(const LS &aLS, int aStride, int aRowBegin, int aRowEnd, int aColumnBegin, int aColumnEnd, double aSlice,
+                   FieldBuffer<FieldValue> &aPhi)
+   {
+      Interval tBounds = tile_bounds(aLS, aStride, aRowBegin, aRowEnd, aColumnBegin, aColumnEnd, aSlice);
+      if (!(tBounds.mLower > 0 || tBounds.mUpper < 0))
+      {
+         return false;
+      }
+
+      int tNumPoints = NUM_POINTS / aStride;
+      FieldValue tSentinel = tBounds.mLower > 0 ? std::numeric_limits<FieldValue>::infinity() : -std::numeric_limits<FieldValue>::infinity();
+      for (int iX = aRowBegin; iX < aRowEnd; iX++)
+      {
+         std::fill(&aPhi[iX * tNumPoints + aColumnBegin], &aPhi[iX * tNumPoints + aColumnEnd], tSentinel);
+      }
+      return true;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Samples the signs of a level-set function on rows [aRowBegin, aRowEnd) of every aStride-th point of the grid
+    * at the z-slice aSlice, one tile of SIGN_TILE columns at a time. Tiles that interval bounds prove strictly
+    * positive or negative are filled with +-infinity, only tiles that may contain the interface are evaluated
+    * point by point. Expressions without bytecode, or separable ones, which are already cheap, are sampled in full
+    */
+   void sample_field_signs(const LS &aLS, int aStride, int aRowBegin, int aRowEnd, double aSlice, FieldBuffer<FieldValue> &aPhi)
+   {
+      FieldBuffer<FieldValue> tNoGradient;
+      if (!aLS.program() || aLS.program()->separable())
+      {
+         sample_field_rows(aLS, aStride, aRowBegin, aRowEnd, aSlice, aPhi, tNoGradient);
+         return;
+      }
+
+      int tNumPoints = NUM_POINTS / aStride;
+      std::vector<double> tXs, tZs, tTile;
+      sample_coordinates(aStride, aRowBegin, aRowEnd, tXs, tZs);
+
+      for (int iColumn = 0; iColumn < tNumPoints; iColumn += SIGN_TILE)
+      {
+         int tColumnEnd = std::min(iColumn + SIGN_TILE, tNumPoints);
+         if (prune_tile(aLS, aStride, aRowBegin, aRowEnd, iColumn, tColumnEnd, aSlice, aPhi))
+         {
+            continue;
+         }
+
+         int tWidth = tColumnEnd - iColumn;
+         tTile.resize(tXs.size() * tWidth);
+         eval_LS_grid(aLS, tXs.data(), tXs.size(), &tZs[iColumn], tWidth, aSlice, tTile.data());
+         for (int iX = aRowBegin; iX < aRowEnd; iX++)
+         {
+            std::copy(&tTile[(iX - aRowBegin) * tWidth], &tTile[(iX - aRowBegin + 1) * tWidth], &aPhi[iX * tNumPoints + iColumn]);
+         }
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Samples the signs of several fields like sample_field_signs. Every level-set prunes its own tiles,
+    * and tiles where more than one level-set is undecided are evaluated with the shared program
+    */
+   void sample_scene_signs(const LSProgram &aScene, const std::vector<const LS *> &aLevelSets, const std::vector<Field *> &aFields,
+                           int aStride, int aRowBegin, int aRowEnd, double aSlice)
+   {
+      int tNumPoints = NUM_POINTS / aStride;
+      std::vector<double> tXs, tZs;
+      sample_coordinates(aStride, aRowBegin, aRowEnd, tXs, tZs);
+
+      std::vector<std::vector<double>> tTiles(aFields.size());
+      std::vector<double *> tTilePointers(aFields.size());
+      std::vector<size_t> tUndecided;
+      for (int iColumn = 0; iColumn < tNumPoints; iColumn += SIGN_TILE)
+      {
+         int tColumnEnd = std::min(iColumn + SIGN_TILE, tNumPoints);
+         int tWidth = tColumnEnd - iColumn;
+
+         tUndecided.clear();
+         for (size_t iField = 0; iField < aFields.size(); iField++)
+         {
+            if (!prune_tile(*aLevelSets[iField], aStride, aRowBegin, aRowEnd, iColumn, tColumnEnd, aSlice, aFields[iField]->mPhi))
+            {
+               tUndecided.push_back(iField);
+            }
+         }
+
+         if (tUndecided.size() == 1)
+         {
+            tTiles[0].resize(tXs.size() * tWidth);
+            eval_LS_grid(*aLevelSets[tUndecided[0]], tXs.data(), tXs.size(), &tZs[iColumn], tWidth, aSlice, tTiles[0].data());
+            tTilePointers[tUndecided[0]] = tTiles[0].data();
+         }
+         else if (tUndecided.size() > 1)
+         {
+            for (size_t iField = 0; iField < aFields.size(); iField++)
+            {
+               tTiles[iField].resize(tXs.size() * tWidth);
+               tTilePointers[iField] = tTiles[iField].data();
+            }
+            aScene.eval_grid_outputs(tXs.data(), tXs.size(), &tZs[iColumn], tWidth, aSlice, tTilePointers.data());
+         }
+
+         for (size_t iField : tUndecided)
+         {
+            for (int iX = aRowBegin; iX < aRowEnd; iX++)
+            {
+               const double *tRow = tTilePointers[iField] + (iX - aRowBegin) * tWidth;
+               std::copy(tRow, tRow + tWidth, &aFields[iField]->mPhi[iX * tNumPoints + iColumn]);
+            }
+         }
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Gets the bytecode shared by several level-sets, with identical subexpressions merged across them.
+    * The programs of the last few groups are kept, and the instructions evaluated per point with and without
+    * sharing are reported when a group is first built. Returns nullptr if the level-sets share nothing
+    */
+   std::shared_ptr<const LSProgram> scene_program(const std::vector<const LS *> &aLevelSets)
+   {
+      std::vector<std::string> tSources;
+      size_t tSeparate = 0;
+      for (const LS *tLS : aLevelSets)
+      {
+         tSources.push_back(tLS->source());
+         tSeparate += tLS->program()->num_instructions();
+      }
+
+      for (const auto &[tKey, tProgram] : gScenePrograms)
+      {
+         if (tKey == tSources)
+         {
+            return tProgram;
+         }
+      }
+
+      std::shared_ptr<const LSProgram> tProgram = LSProgram::compile_scene(tSources);
+      if (tProgram)
+      {
+         std::cout << "Shared bytecode of " << aLevelSets.size() << " level-sets: " << tProgram->num_instructions()
+                   << " instructions per point, " << tSeparate << " without sharing\n";
+         if (tProgram->num_instructions() == tSeparate)
+         {
+            tProgram = nullptr;
+         }
+      }
+
+      if (gScenePrograms.size() == SCENE_CACHE_SIZE)
+      {
+         gScenePrograms.erase(gScenePrograms.begin());
+      }
+      gScenePrograms.push_back({tSources, tProgram});
+      return tProgram;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Key of the field of a level-set at the z-slice aSlice, with the current domain and parameter values
+    */
+   FieldKey field_key(const LS &aLS, int aStride, SAMPLING aSampling, double aSlice)
+   {
+      FieldKey tKey = {aLS.source(), gXLB, gXUB, gZLB, gZUB, aSlice, aStride, aSampling, {}};
+      for (uint tParameter : aLS.parameters())
+      {
+         tKey.mParameters.push_back(gParameterValues[tParameter]);
+      }
+      return tKey;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Background sampling of the z-slices around the current one. Every frame records the fields it used, and once
+    * the frame is drawn the worker samples the same fields VOLUME_SLICES wheel steps above and below, nearest slices
+    * first. Scrolling then takes its fields from here instead of sampling them. The worker has its own thread and
+    * samples one field at a time, so it never holds up the evaluation pool
+    */
+   class SliceSampler
+   {
+    public:
+      SliceSampler()
+          : mWorker(&SliceSampler::worker_loop, this)
+      {
+      }
+
+      ~SliceSampler()
+      {
+         {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+         }
+         mWake.notify_all();
+         mWorker.join();
+      }
+
+      /**
+       * Records a field used by the current frame
+       */
+      void use(const LS &aLS, int aStride, SAMPLING aSampling)
+      {
+         for (const Use &tUse : mUsed)
+         {
+            if (tUse.mLS.id() == aLS.id() && tUse.mStride == aStride && tUse.mSampling == aSampling)
+            {
+               return;
+            }
+         }
+         mUsed.push_back({aLS, aStride, aSampling});
+      }
+
+      /**
+       * Queues the fields used by the current frame at the slices around aSlice that are neither sampled yet nor
+       * in aFieldCache, and drops sampled fields that are no longer around aSlice. Called once per frame
+       */
+      void submit(double aSlice, const std::vector<Field> &aFieldCache)
+      {
+         // The slices the wheel reaches from aSlice, nearest first, computed the same way the wheel steps
+         std::vector<double> tSlices;
+         double tUp = aSlice;
+         double tDown = aSlice;
+         for (uint iStep = 0; iStep < VOLUME_SLICES; iStep++)
+         {
+            tUp += SCROLL_STEP;
+            tDown -= SCROLL_STEP;
+            tSlices.push_back(tUp);
+            tSlices.push_back(tDown);
+         }
+
+         std::vector<Job> tJobs;
+         for (double tSlice : tSlices)
+         {
+            for (const Use &tUse : mUsed)
+            {
+               tJobs.push_back({tUse.mLS, field_key(tUse.mLS, tUse.mStride, tUse.mSampling, tSlice)});
+            }
+         }
+         mUsed.clear();
+
+         std::lock_guard<std::mutex> lock(mMutex);
+         mFields.erase(std::remove_if(mFields.begin(), mFields.end(), [&tJobs](const Field &aField)
+                                      { return std::none_of(tJobs.begin(), tJobs.end(), [&aField](const Job &aJob)
+                                                            { return aJob.mKey == aField.mKey; }); }),
+                       mFields.end());
+         mWanted.clear();
+         mQueue.clear();
+         for (Job &tJob : tJobs)
+         {
+            mWanted.push_back(tJob.mKey);
+            bool tDone = tJob.mKey == mBusy ||
+                         std::any_of(aFieldCache.begin(), aFieldCache.end(), [&tJob](const Field &aField)
+                                     { return aField.mVersion != 0 && aField.mKey == tJob.mKey; }) ||
+                         std::any_of(mFields.begin(), mFields.end(), [&tJob](const Field &aField)
+                                     { return aField.mKey == tJob.mKey; });
+            if (!tDone)
+            {
+               mQueue.push_back(std::move(tJob));
+            }
+         }
+         mWake.notify_all();
+      }
+
+      /**
+       * Moves a sampled field with key aKey into aField, returns false if there is none
+       */
+      bool take(const FieldKey &aKey, Field &aField)
+      {
+         std::lock_guard<std::mutex> lock(mMutex);
+         auto tFound = std::find_if(mFields.begin(), mFields.end(), [&aKey](const Field &tField)
+                                    { return tField.mKey == aKey; });
+         if (tFound == mFields.end())
+         {
+            return false;
+         }
+         aField.mPhi = std::move(tFound->mPhi);
+         aField.mGradient = std::move(tFound->mGradient);
+         mFields.erase(tFound);
+         return true;
+      }
+
+    private:
+      // A field used by the current frame
+      struct Use
+      {
+         LS mLS;
+         int mStride;
+         SAMPLING mSampling;
+      };
+
+      // A field to sample
+      struct Job
+      {
+         LS mLS;
+         FieldKey mKey;
+      };
+
+      void worker_loop()
+      {
+         while (true)
+         {
+            Job tJob;
+            {
+               std::unique_lock<std::mutex> lock(mMutex);
+               mWake.wait(lock, [this]()
+                          { return mStop || !mQueue.empty(); });
+               if (mStop)
+               {
+                  return;
+               }
+               tJob = std::move(mQueue.front());
+               mQueue.erase(mQueue.begin());
+               mBusy = tJob.mKey;
+            }
+
+            // The render path holds gLevelSetMutex, which this thread doesn't, so parameter changes wait for the field
+            std::unique_lock<std::mutex> tValuesLock(gParameterValuesMutex);
+            Field tField;
+            tField.mKey = tJob.mKey;
+            int tNumRows = NUM_POINTS / tJob.mKey.mStride;
+            tField.mPhi.resize(tNumRows * tNumRows);
+            tField.mGradient.resize(tJob.mKey.mSampling == SAMPLING::GRADIENT ? 3 * tField.mPhi.size() : 0);
+            if (tJob.mKey.mSampling == SAMPLING::SIGNS)
+            {
+               sample_field_signs(tJob.mLS, tJob.mKey.mStride, 0, tNumRows, tJob.mKey.mSlice, tField.mPhi);
+            }
+            else
+            {
+               sample_field_rows(tJob.mLS, tJob.mKey.mStride, 0, tNumRows, tJob.mKey.mSlice, tField.mPhi, tField.mGradient);
+            }
+
+            // Keep the field if it is still wanted, and the domain and parameters didn't change since the job was queued
+            bool tCurrent = field_key(tJob.mLS, tJob.mKey.mStride, tJob.mKey.mSampling, tJob.mKey.mSlice) == tJob.mKey;
+            tValuesLock.unlock();
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBusy = FieldKey{};
+            bool tWanted = std::any_of(mWanted.begin(), mWanted.end(), [&tJob](const FieldKey &aKey)
+                                       { return aKey == tJob.mKey; });
+            if (tWanted && tCurrent)
+            {
+               mFields.push_back(std::move(tField));
+            }
+         }
+      }
+
+      std::vector<Use> mUsed;        // Fields used by the current frame, only touched by the main thread
+      std::vector<FieldKey> mWanted; // Keys of the fields around the current slice
+      std::vector<Job> mQueue;       // Fields still to sample, nearest slices first
+      FieldKey mBusy{};              // Key of the field the worker is sampling
+      std::vector<Field> mFields;    // Sampled fields, waiting to be taken
+      std::mutex mMutex;             // Protects everything but mUsed
+      std::condition_variable mWake; // Wakes the worker when there is work or on shutdown
+      bool mStop = false;            // Set when the sampler shuts down
+      std::thread mWorker;           // Started last, once the members it uses exist
+   };
+
+   /**
+    * Gets the background slice sampler, started on first use
+    */
+   SliceSampler &slice_sampler()
+   {
+      static SliceSampler tSampler;
+      return tSampler;
+   }
+
+   //-----------------------------------------------------------------------
+
+#ifdef DISK_CACHE
+   /**
+    * Sampled fields kept on disk between runs, so a restart on the same geometries maps its first fields instead of
+    * sampling them. Every field is a file named by a hash of its key, holding a header, the full key and the values.
+    * A file is only used if its value size, key and array sizes all match, so files of another build, resolution or
+    * hash collision are ignored. Fields are written by a background thread and the least recently used files are
+    * removed beyond DISK_CACHE_ENTRIES
+    */
+   class DiskCache
+   {
+    public:
+      DiskCache()
+          : mDirectory(cache_directory() / "moris_gui_fields"),
+            mWriter(&DiskCache::writer_loop, this)
+      {
+      }
+
+      ~DiskCache()
+      {
+         {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+         }
+         mWake.notify_all();
+         mWriter.join();
+      }
+
+      /**
+       * Maps the file of a field and copies its values into aField, returns false if there is no valid file
+       */
+      bool load(const FieldKey &aKey, Field &aField) const
+      {
+         std::string tText = key_text(aKey);
+         std::string tPath = path(tText).string();
+         int tFile = open(tPath.c_str(), O_RDONLY);
+         if (tFile < 0)
+         {
+            return false;
+         }
+
+         struct stat tStat;
+         size_t tSize = fstat(tFile, &tStat) == 0 ? tStat.st_size : 0;
+#ifdef MAP_POPULATE
+         const int tFlags = MAP_PRIVATE | MAP_POPULATE; // Map all pages at once instead of faulting them in one by one
+#else
+         const int tFlags = MAP_PRIVATE;
+#endif
+         void *tMap = tSize >= sizeof(Header) ? mmap(nullptr, tSize, PROT_READ, tFlags, tFile, 0) : MAP_FAILED;
+         close(tFile);
+         if (tMap == MAP_FAILED)
+         {
+            return false;
+         }
+
+         const char *tData = static_cast<const char *>(tMap);
+         Header tHeader;
+         std::memcpy(&tHeader, tData, sizeof(Header));
+         size_t tNumPhi = (NUM_POINTS / aKey.mStride) * (NUM_POINTS / aKey.mStride);
+         size_t tNumGradient = aKey.mSampling == SAMPLING::GRADIENT ? 3 * tNumPhi : 0;
+         size_t tOffset = values_offset(tText.size());
+
+         bool tValid = std::memcmp(tHeader.mMagic, MAGIC, sizeof(tHeader.mMagic)) == 0 &&
+                       tHeader.mValueSize == sizeof(FieldValue) && tHeader.mKeySize == tText.size() &&
+                       tHeader.mNumPhi == tNumPhi && tHeader.mNumGradient == tNumGradient &&
+                       tSize == tOffset + (tNumPhi + tNumGradient) * sizeof(FieldValue) &&
+                       std::memcmp(tData + sizeof(Header), tText.data(), tText.size()) == 0;
+         if (tValid)
+         {
+            const FieldValue *tValues = reinterpret_cast<const FieldValue *>(tData + tOffset);
+            aField.mPhi.assign(tValues, tValues + tNumPhi);
+            aField.mGradient.assign(tValues + tNumPhi, tValues + tNumPhi + tNumGradient);
+
+            // Mark the file as recently used
+            utimensat(AT_FDCWD, tPath.c_str(), nullptr, 0);
+         }
+         munmap(tMap, tSize);
+         return tValid;
+      }
+
+      /**
+       * Queues a copy of a sampled field to be written to disk
+       */
+      void store(const Field &aField)
+      {
+         {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQueue.push_back({key_text(aField.mKey), aField.mPhi, aField.mGradient});
+            if (mQueue.size() > DISK_CACHE_PENDING)
+            {
+               mQueue.erase(mQueue.begin());
+            }
+         }
+         mWake.notify_all();
+      }
+
+    private:
+      static constexpr char MAGIC[8] = {'M', 'O', 'R', 'I', 'S', 'F', 'L', 'D'};
+
+      // Start of every file, followed by the key text and, from values_offset, the values of mPhi and mGradient
+      struct Header
+      {
+         char mMagic[8];
+         uint32_t mValueSize;
+         uint32_t mKeySize;
+         uint64_t mNumPhi;
+         uint64_t mNumGradient;
+      };
+
+      // A field waiting to be written
+      struct Pending
+      {
+         std::string mText;
+         FieldBuffer<FieldValue> mPhi;
+         FieldBuffer<FieldValue> mGradient;
+      };
+
+      /**
+       * Text of a field key with exact doubles, the identity of a file
+       */
+      static std::string key_text(const FieldKey &aKey)
+      {
+         std::ostringstream tText;
+         tText << std::hexfloat << aKey.mSource << '\n'
+               << aKey.mXLB << ' ' << aKey.mXUB << ' ' << aKey.mZLB << ' ' << aKey.mZUB << ' ' << aKey.mSlice << '\n'
+               << NUM_POINTS << ' ' << aKey.mStride << ' ' << static_cast<int>(aKey.mSampling) << '\n';
+         for (double tParameter : aKey.mParameters)
+         {
+            tText << tParameter << ' ';
+         }
+         return tText.str();
+      }
+
+      std::filesystem::path path(const std::string &aText) const
+      {
+         return mDirectory / (stable_hash(aText) + ".field");
+      }
+
+      static size_t values_offset(size_t aKeySize)
+      {
+         size_t tOffset = sizeof(Header) + aKeySize;
+         return (tOffset + FIELD_ALIGNMENT - 1) / FIELD_ALIGNMENT * FIELD_ALIGNMENT;
+      }
+
+      void writer_loop()
+      {
+         std::error_code tError;
+         std::filesystem::create_directories(mDirectory, tError);
+
+         while (true)
+         {
+            Pending tPending;
+            {
+               std::unique_lock<std::mutex> lock(mMutex);
+               mWake.wait(lock, [this]()
+                          { return mStop || !mQueue.empty(); });
+               if (mStop)
+               {
+                  return;
+               }
+               tPending = std::move(mQueue.front());
+               mQueue.erase(mQueue.begin());
+            }
+
+            write(tPending);
+            evict();
+         }
+      }
+
+      /**
+       * Writes a field under a unique name and renames it, so a reader never sees a partly written file
+       */
+      void write(const Pending &aPending) const
+      {
+         Header tHeader;
+         std::memcpy(tHeader.mMagic, MAGIC, sizeof(tHeader.mMagic));
+         tHeader.mValueSize = sizeof(FieldValue);
+         tHeader.mKeySize = aPending.mText.size();
+         tHeader.mNumPhi = aPending.mPhi.size();
+         tHeader.mNumGradient = aPending.mGradient.size();
+         std::string tPadding(values_offset(aPending.mText.size()) - sizeof(Header) - aPending.mText.size(), '\0');
+
+         std::filesystem::path tPath = path(aPending.mText);
+         std::filesystem::path tTemporary = tPath;
+         tTemporary += "." + std::to_string(getpid());
+         {
+            std::ofstream tFile(tTemporary, std::ios::binary);
+            tFile.write(reinterpret_cast<const char *>(&tHeader), sizeof(Header));
+            tFile.write(aPending.mText.data(), aPending.mText.size());
+            tFile.write(tPadding.data(), tPadding.size());
+            tFile.write(reinterpret_cast<const char *>(aPending.mPhi.data()), aPending.mPhi.size() * sizeof(FieldValue));
+            tFile.write(reinterpret_cast<const char *>(aPending.mGradient.data()), aPending.mGradient.size() * sizeof(FieldValue));
+            if (tFile)
+            {
+               tFile.close();
+            }
+            if (!tFile)
+            {
+               std::error_code tError;
+               std::filesystem::remove(tTemporary, tError);
+               return;
+            }
+         }
+
+         std::error_code tError;
+         std::filesystem::rename(tTemporary, tPath, tError);
+      }
+
+      /**
+       * Removes the least recently used files beyond DISK_CACHE_ENTRIES
+       */
+      void evict() const
+      {
+         std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> tFiles;
+         std::error_code tError;
+         for (const auto &tEntry : std::filesystem::directory_iterator(mDirectory, tError))
+         {
+            if (tEntry.path().extension() == ".field")
+            {
+               tFiles.push_back({tEntry.last_write_time(tError), tEntry.path()});
+            }
+         }
+         if (tFiles.size() <= DISK_CACHE_ENTRIES)
+         {
+            return;
+         }
+
+         std::sort(tFiles.begin(), tFiles.end());
+         for (size_t iFile = 0; iFile < tFiles.size() - DISK_CACHE_ENTRIES; iFile++)
+         {
+            std::filesystem::remove(tFiles[iFile].second, tError);
+         }
+      }
+
+      std::filesystem::path mDirectory; // Directory of the field files
+      std::vector<Pending> mQueue;      // Fields still to write, oldest first
+      std::mutex mMutex;                // Protects mQueue and mStop
+      std::condition_variable mWake;    // Wakes the writer when there is work or on shutdown
+      bool mStop = false;               // Set when the cache shuts down
+      std::thread mWriter;              // Started last, once the members it uses exist
+   };
+
+   /**
+    * Gets the disk cache of sampled fields, its writer is started on first use
+    */
+   DiskCache &disk_cache()
+   {
+      static DiskCache tCache;
+      return tCache;
+   }
+
+   /**
+    * Queues a field for the disk cache once it is still in use DISK_CACHE_FRAMES frames after it was sampled. Fields of
+    * parameter sweeps and of slices scrolled past are replaced before that, so they neither cost the writes nor push
+    * the fields a restart needs out of the cache
+    */
+   void store_if_kept(const Field &aField)
+   {
+      if (!aField.mStored && gFrame - aField.mSampledFrame >= DISK_CACHE_FRAMES)
+      {
+         aField.mStored = true;
+         disk_cache().store(aField);
+      }
+   }
+#endif
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Gets the sampled fields of several level-set functions from the field cache.
+    * A field is only evaluated if its expression, the parameters it uses, the domain, the z-slice or the resolution changed.
+    * Missing fields are evaluated together on the thread pool, tiled by geometry and row band
+    *
+    * @param aLevelSets Level-sets to get the fields for
+    * @param aStride Every aStride-th grid point is sampled
+    * @param aSampling What to sample
+    */
+   std::vector<const Field *> get_fields(const std::vector<const LS *> &aLevelSets, int aStride, SAMPLING aSampling = SAMPLING::VALUES)
+   {
+      std::vector<const Field *> tFields(aLevelSets.size());
+      std::vector<std::pair<const LS *, Field *>> tMissing;
+
+      for (size_t iLS = 0; iLS < aLevelSets.size(); iLS++)
+      {
+         FieldKey tKey = field_key(*aLevelSets[iLS], aStride, aSampling, gZ);
+         slice_sampler().use(*aLevelSets[iLS], aStride, aSampling);
+
+         // Look for a field that was sampled with the same inputs, otherwise replace the least recently used one
+         Field *tOldest = &gFieldCache[0];
+         Field *tFound = nullptr;
+         for (Field &tField : gFieldCache)
+         {
+            if (tField.mVersion != 0 && tField.mKey == tKey)
+            {
+               tFound = &tField;
+               break;
+            }
+            if (tField.mLastUsed < tOldest->mLastUsed)
+            {
+               tOldest = &tField;
+            }
+         }
+
+         if (!tFound)
+         {
+            // Fields of the slices next to the previous one were usually sampled in the background already
+            tFound = tOldest;
+            tFound->mKey = tKey;
+            tFound->mVersion = ++gFieldVersion;
+            tFound->mRoots.clear();
+            tFound->mRootGradients.clear();
+            bool tSampled = slice_sampler().take(tKey, *tFound);
+            tFound->mSampledFrame = gFrame;
+            tFound->mStored = false;
+#ifdef DISK_CACHE
+            // Then look for it on disk, written by this or an earlier run
+            tFound->mStored = !tSampled && disk_cache().load(tKey, *tFound);
+            tSampled = tSampled || tFound->mStored;
+#endif
+            if (!tSampled)
+            {
+               tFound->mPhi.resize((NUM_POINTS / aStride) * (NUM_POINTS / aStride));
+               tFound->mGradient.resize(aSampling == SAMPLING::GRADIENT ? 3 * tFound->mPhi.size() : 0);
+               tMissing.push_back({aLevelSets[iLS], tFound});
+            }
+         }
+
+         tFound->mLastUsed = gFrame;
+#ifdef DISK_CACHE
+         store_if_kept(*tFound);
+#endif
+         tFields[iLS] = tFound;
+      }
+
+      // Missing fields with non-separable bytecode are evaluated together if their expressions share anything
+      std::vector<const LS *> tSharedLevelSets;
+      std::vector<Field *> tSharedFields;
+      std::vector<std::pair<const LS *, Field *>> tSingle;
+      for (const auto &[tLS, tField] : tMissing)
+      {
+         bool tShare = tLS->program() && !tLS->program()->separable();
+#ifdef JIT
+         tShare = tShare && !(tLS->native() && tLS->native()->grid());
+#endif
+         if (tShare)
+         {
+            tSharedLevelSets.push_back(tLS);
+            tSharedFields.push_back(tField);
+         }
+         else
+         {
+            tSingle.push_back({tLS, tField});
+         }
+      }
+
+      std::shared_ptr<const LSProgram> tScene;
+      if (tSharedLevelSets.size() > 1)
+      {
+         tScene = scene_program(tSharedLevelSets);
+      }
+      if (!tScene)
+      {
+         for (size_t iShared = 0; iShared < tSharedFields.size(); iShared++)
+         {
+            tSingle.push_back({tSharedLevelSets[iShared], tSharedFields[iShared]});
+         }
+      }
+
+      // Evaluate the missing fields, one task per row band of the shared fields or of one single field.
+      // Sign fields use bands of whole tiles
+      int tNumRows = NUM_POINTS / aStride;
+      int tRowsPerTask = aSampling == SAMPLING::SIGNS ? SIGN_TILE : ROWS_PER_TASK;
+      uint tBandsPerField = (tNumRows + tRowsPerTask - 1) / tRowsPerTask;
+      uint tSceneTasks = tScene ? tBandsPerField : 0;
+      thread_pool().parallel_for(tSceneTasks + tSingle.size() * tBandsPerField, [&](uint aTask)
+                                 {
+         if (aTask < tSceneTasks)
+         {
+            int tRowBegin = aTask * tRowsPerTask;
+            int tRowEnd = std::min(tRowBegin + tRowsPerTask, tNumRows);
+            if (aSampling == SAMPLING::SIGNS)
+            {
+               sample_scene_signs(*tScene, tSharedLevelSets, tSharedFields, aStride, tRowBegin, tRowEnd, gZ);
+            }
+            else
+            {
+               sample_scene_rows(*tScene, tSharedFields, aStride, tRowBegin, tRowEnd, gZ);
+            }
+            return;
+         }
+         aTask -= tSceneTasks;
+
+         const auto &[tLS, tField] = tSingle[aTask / tBandsPerField];
+         int tRowBegin = (aTask % tBandsPerField) * tRowsPerTask;
+         int tRowEnd = std::min(tRowBegin + tRowsPerTask, tNumRows);
+         if (aSampling == SAMPLING::SIGNS)
+         {
+            sample_field_signs(*tLS, aStride, tRowBegin, tRowEnd, gZ, tField->mPhi);
+         }
+         else
+         {
+            sample_field_rows(*tLS, aStride, tRowBegin, tRowEnd, gZ, tField->mPhi, tField->mGradient);
+         } });
+
+      return tFields;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Gets the sampled field of a single level-set function from the field cache
+    *
+    * @param aStride Every aStride-th grid point is sampled
+    * @param aSampling What to sample
+    */
+   const Field &get_field(const LS &aLS, int aStride, SAMPLING aSampling = SAMPLING::VALUES)
+   {
+      return *get_fields({&aLS}, aStride, aSampling)[0];
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Keeps fields from an earlier get_fields call in use without looking up their keys, for callers that know from the
+    * scene generations that their inputs are unchanged. Returns false if a field was evicted since, then get_fields is needed
+    *
+    * @param aFields Fields returned by get_fields for aLevelSets
+    * @param aVersions Versions of the fields when they were returned
+    */
+   bool reuse_fields(const std::vector<const LS *> &aLevelSets, int aStride, SAMPLING aSampling,
+                     const std::vector<const Field *> &aFields, const std::vector<uint> &aVersions)
+   {
+      if (aFields.size() != aLevelSets.size() || aVersions.size() != aLevelSets.size())
+      {
+         return false;
+      }
+      for (size_t iLS = 0; iLS < aFields.size(); iLS++)
+      {
+         if (aFields[iLS]->mVersion != aVersions[iLS])
+         {
+            return false;
+         }
+      }
+
+      for (size_t iLS = 0; iLS < aFields.size(); iLS++)
+      {
+         aFields[iLS]->mLastUsed = gFrame;
+#ifdef DISK_CACHE
+         store_if_kept(*aFields[iLS]);
+#endif
+         slice_sampler().use(*aLevelSets[iLS], aStride, aSampling);
+      }
+      return true;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Builds the triangle strips of a level-set surface from its sampled field and gradients,
+    * splitting triangle strips when vertices don't match the sign condition. aField must be sampled with gradients
+    */
+   void build_surface_strips(const LS &aLS, const Field &aField, PHASE aSign, StripMesh &aMesh)
+   {
+      aMesh.clear();
+
+      int tNumPoints = NUM_POINTS / PLOT_STRIDE;
+      int tNumVerts = tNumPoints * tNumPoints;
+      const FieldBuffer<FieldValue> &tPhiVals = aField.mPhi;
+      const FieldValue *tGradX = &aField.mGradient[0];
+      const FieldValue *tGradY = &aField.mGradient[tNumVerts];
+
+      // Normals of every grid vertex from the cached gradient planes, the storage is kept between calls
+      thread_local FieldBuffer<double> tNormals;
+      tNormals.resize(3 * tNumVerts);
+      for (int iV = 0; iV < tNumVerts; iV++)
+      {
+         const double tGradient[2] = {tGradX[iV], tGradY[iV]};
+         plotter_normal(tGradient, &tNormals[3 * iV]);
+      }
+
+      for (int i = 0; i < tNumPoints - 1; i++)
+      {
+         bool stripOpen = false;
+         double x0 = gXVals[i * PLOT_STRIDE];
+         double x1 = gXVals[(i + 1) * PLOT_STRIDE];
+         for (int j = 0; j < tNumPoints; j++)
+         {
+            double z = gZVals[j * PLOT_STRIDE]; // Since OpenGL Y is up, we use Z here. LS function is still (x,y)
+            double y0 = tPhiVals[i * tNumPoints + j];
+            double y1 = tPhiVals[(i + 1) * tNumPoints + j];
+            const double *n0 = &tNormals[3 * (i * tNumPoints + j)];
+            const double *n1 = &tNormals[3 * ((i + 1) * tNumPoints + j)];
+
+            bool tValid0 = !((aSign == PHASE::POSITIVE && y0 < 0) || (aSign == PHASE::NEGATIVE && y0 > 0));
+            bool tValid1 = !((aSign == PHASE::POSITIVE && y1 < 0) || (aSign == PHASE::NEGATIVE && y1 > 0));
+
+            // If both vertices are valid, emit them into the strip.
+            // If exactly one is valid, compute the zero-level crossing along the edge
+            // and emit that intersection in place of the invalid vertex.
+            if (tValid0 || tValid1)
+            {
+               if (!stripOpen)
+               {
+                  aMesh.begin_strip();
+                  stripOpen = true;
+               }
+
+               if (tValid0 && tValid1)
+               {
+                  // both vertices are in the desired plotting domain
+                  aMesh.add_vertex(x0, y0, z, n0[0], n0[1], n0[2]);
+                  aMesh.add_vertex(x1, y1, z, n1[0], n1[1], n1[2]);
+               }
+               else if (gIsocontour)
+               {
+                  // Sign change, intersection root along the x0-x1 edge, shared with the other sign condition
+                  double tRootGradient[3];
+                  double tXRoot = edge_root(aLS, aField, 0, i, j, tRootGradient);
+
+                  // normal at root (phi ~ 0) from the gradient of the last root iteration
+                  double nr[3];
+                  plotter_normal(tRootGradient, nr);
+
+                  if (tValid0)
+                  {
+                     // Plot vertex 0 and root
+                     aMesh.add_vertex(x0, y0, z, n0[0], n0[1], n0[2]);
+                     aMesh.add_vertex(tXRoot, 0.0, z, nr[0], nr[1], nr[2]);
+                  }
+                  else
+                  {
+                     // Plot root and vertex 1
+                     aMesh.add_vertex(tXRoot, 0.0, z, nr[0], nr[1], nr[2]);
+                     aMesh.add_vertex(x1, y1, z, n1[0], n1[1], n1[2]);
+                  }
+               }
+            }
+            else
+            {
+               // both invalid: close strip if open
+               stripOpen = false;
+            }
+         }
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Draws a level-set surface in the plotter view. The surface of each sign condition is kept until its field changes
+    */
+   void drawLS(uint aGeometry, PHASE aSign, int aColorIndex)
+   {
+      // Check if we need to plot this geometry
+      if (aSign == PHASE::NONE)
+      {
+         return; // don't plot
+      }
+
+      const LS &tLS = gLevelSets[aGeometry];
+      const Field &tField = get_field(tLS, PLOT_STRIDE, SAMPLING::GRADIENT);
+
+      SurfaceMesh &tSurface = gSurfaceMeshes[aGeometry];
+      uint tSign = static_cast<uint>(aSign) - static_cast<uint>(PHASE::POSITIVE);
+      if (tSurface.mFieldVersion[tSign] != tField.mVersion || tSurface.mIsocontour[tSign] != gIsocontour)
+      {
+         build_surface_strips(tLS, tField, aSign, tSurface.mStrips[tSign]);
+         tSurface.mFieldVersion[tSign] = tField.mVersion;
+         tSurface.mIsocontour[tSign] = gIsocontour;
+      }
+
+      glPushMatrix();
+
+      // Set color for this geometry
+      glColor3d(gColors[aColorIndex][0], gColors[aColorIndex][1], gColors[aColorIndex][2]);
+
+      const StripMesh &tStrips = tSurface.mStrips[tSign];
+      for (uint iS = 0; iS < tStrips.num_strips(); iS++)
+      {
+         glBegin(GL_TRIANGLE_STRIP);
+         for (uint iV = tStrips.mStripStarts[iS]; iV < tStrips.strip_end(iS); iV++)
+         {
+            glNormal3dv(&tStrips.mNormals[3 * iV]);
+            glVertex3dv(&tStrips.mVertices[3 * iV]);
+         }
+         glEnd();
+      }
+
+      glPopMatrix();
+
+      ErrCheck("drawLS");
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Signs of 8 consecutive field values, bit k is set where aPhi[k] >= 0. NaN counts as negative
+    */
+   inline uint sign_mask(const FieldValue *aPhi)
+   {
+#if defined(FIELD_FLOAT) && defined(__AVX2__)
+      return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(aPhi), _mm256_setzero_ps(), _CMP_GE_OQ));
+#elif defined(FIELD_FLOAT) && defined(__SSE2__)
+      __m128 tZero = _mm_setzero_ps();
+      return _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(aPhi), tZero)) |
+             _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(aPhi + 4), tZero)) << 4;
+#elif defined(__AVX2__)
+      __m256d tZero = _mm256_setzero_pd();
+      return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(aPhi), tZero, _CMP_GE_OQ)) |
+             _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(aPhi + 4), tZero, _CMP_GE_OQ)) << 4;
+#elif defined(__SSE2__)
+      __m128d tZero = _mm_setzero_pd();
+      return _mm_movemask_pd(_mm_cmpge_pd(_mm_loadu_pd(aPhi), tZero)) |
+             _mm_movemask_pd(_mm_cmpge_pd(_mm_loadu_pd(aPhi + 2), tZero)) << 2 |
+             _mm_movemask_pd(_mm_cmpge_pd(_mm_loadu_pd(aPhi + 4), tZero)) << 4 |
+             _mm_movemask_pd(_mm_cmpge_pd(_mm_loadu_pd(aPhi + 6), tZero)) << 6;
+#else
+      uint tMask = 0;
+      for (uint iLane = 0; iLane < 8; iLane++)
+      {
+         tMask |= aPhi[iLane] >= 0 ? 1u << iLane : 0u;
+      }
+      return tMask;
+#endif
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Spreads the 8 bits of a sign mask to the lowest bit of each byte of a word, in memory order
+    */
+   inline std::uint64_t spread_sign_mask(uint aMask)
+   {
+      static const std::vector<std::uint64_t> tSpread = []()
+      {
+         std::vector<std::uint64_t> tTable(256, 0);
+         for (uint iMask = 0; iMask < 256; iMask++)
+         {
+            for (uint iLane = 0; iLane < 8; iLane++)
+            {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+               uint tByte = 7 - iLane;
+#else
+               uint tByte = iLane;
+#endif
+               tTable[iMask] |= static_cast<std::uint64_t>((iMask >> iLane) & 1u) << (8 * tByte);
+            }
+         }
+         return tTable;
+      }();
+      return tSpread[aMask];
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * A byte mask repeated in all 8 bytes of a word, to apply it to 8 packed bitsets at once
+    */
+   inline std::uint64_t bitset_word(uint aByteMask)
+   {
+      return 0x0101010101010101ull * (aByteMask & 0xFFu);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Classifies every vertex of the projection grid by the signs of the sampled fields.
+    * Geometry 0 is the most significant bit, see geometry_bit
+    */
+   void classify_phases(const std::vector<const Field *> &aFields)
+   {
+      const size_t tNumVerts = NUM_POINTS * NUM_POINTS;
+      const size_t tNumBlocks = tNumVerts / 8;
+      const uint tNumGeoms = aFields.size();
+      gBitsetGrid.resize(tNumVerts);
+      Bitset *tBitsets = gBitsetGrid.data();
+
+      // One compare and movemask per geometry gives the signs of 8 vertices, shifting them into place
+      // packs the bitsets of all 8 vertices into one word
+      for (size_t iBlock = 0; iBlock < tNumBlocks; iBlock++)
+      {
+         std::uint64_t tWord = 0;
+         for (uint iG = 0; iG < tNumGeoms; iG++)
+         {
+            tWord |= spread_sign_mask(sign_mask(aFields[iG]->mPhi.data() + 8 * iBlock)) << (tNumGeoms - 1 - iG);
+         }
+         std::memcpy(tBitsets + 8 * iBlock, &tWord, sizeof(tWord));
+      }
+
+      for (size_t iVert = 8 * tNumBlocks; iVert < tNumVerts; iVert++)
+      {
+         Bitset tBitset = 0;
+         for (uint iG = 0; iG < tNumGeoms; iG++)
+         {
+            tBitset |= aFields[iG]->mPhi[iVert] >= 0 ? geometry_bit(iG, tNumGeoms) : 0;
+         }
+         tBitsets[iVert] = tBitset;
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Rewrites the bit of a single geometry in the classified grid, the bits of all other geometries are kept.
+    * The cost does not depend on the number of geometries
+    */
+   void reclassify_geometry(uint aGeom, uint aNumGeoms, const Field &aField)
+   {
+      const size_t tNumVerts = NUM_POINTS * NUM_POINTS;
+      const size_t tNumBlocks = tNumVerts / 8;
+      const uint tShift = aNumGeoms - 1 - aGeom;
+      const std::uint64_t tKeep = ~(bitset_word(1u) << tShift);
+      Bitset *tBitsets = gBitsetGrid.data();
+
+      for (size_t iBlock = 0; iBlock < tNumBlocks; iBlock++)
+      {
+         std::uint64_t tWord;
+         std::memcpy(&tWord, tBitsets + 8 * iBlock, sizeof(tWord));
+         tWord = (tWord & tKeep) | spread_sign_mask(sign_mask(aField.mPhi.data() + 8 * iBlock)) << tShift;
+         std::memcpy(tBitsets + 8 * iBlock, &tWord, sizeof(tWord));
+      }
+
+      for (size_t iVert = 8 * tNumBlocks; iVert < tNumVerts; iVert++)
+      {
+         tBitsets[iVert] = (tBitsets[iVert] & ~geometry_bit(aGeom, aNumGeoms)) | (aField.mPhi[iVert] >= 0 ? geometry_bit(aGeom, aNumGeoms) : 0);
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Moves the bits of the geometries before aGeom up by one, which leaves a cleared bit for aGeom.
+    * aNumGeoms is the number of geometries after the insertion
+    */
+   void insert_classified_geometry(uint aGeom, uint aNumGeoms)
+   {
+      const uint tShift = aNumGeoms - 1 - aGeom;
+      const std::uint64_t tHigh = bitset_word(0xFFu << (tShift + 1));
+      const std::uint64_t tLow = bitset_word((1u << tShift) - 1);
+
+      for (size_t iWord = 0; iWord < gBitsetGrid.size(); iWord += 8)
+      {
+         std::uint64_t tWord = 0;
+         size_t tCount = std::min<size_t>(8, gBitsetGrid.size() - iWord);
+         std::memcpy(&tWord, &gBitsetGrid[iWord], tCount);
+         tWord = ((tWord << 1) & tHigh) | (tWord & tLow);
+         std::memcpy(&gBitsetGrid[iWord], &tWord, tCount);
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Drops the bit of a deleted geometry from the classified grid and moves the bits before it down by one,
+    * so the grid stays valid for the remaining geometries without sampling or comparing any field
+    */
+   void remove_classified_geometry(uint aGeom)
+   {
+      uint tNumGeoms = gClassifiedVersions.size();
+      if (aGeom >= tNumGeoms)
+      {
+         return;
+      }
+
+      const uint tShift = tNumGeoms - 1 - aGeom;
+      const std::uint64_t tHigh = bitset_word((0xFFu << tShift) & 0x7Fu);
+      const std::uint64_t tLow = bitset_word((1u << tShift) - 1);
+
+      for (size_t iWord = 0; iWord < gBitsetGrid.size(); iWord += 8)
+      {
+         std::uint64_t tWord = 0;
+         size_t tCount = std::min<size_t>(8, gBitsetGrid.size() - iWord);
+         std::memcpy(&tWord, &gBitsetGrid[iWord], tCount);
+         tWord = ((tWord >> 1) & tHigh) | (tWord & tLow);
+         std::memcpy(&gBitsetGrid[iWord], &tWord, tCount);
+      }
+
+      gClassifiedVersions.erase(gClassifiedVersions.begin() + aGeom);
+      gInterfacesValid = false;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Brings the classified grid up to date with the sampled fields. Only the bits of geometries whose field
+    * changed are rewritten, geometries added at the end get a new bit. The grid is only classified from
+    * scratch when it is empty, geometries were removed behind its back or every field changed
+    */
+   void update_classification(const std::vector<const Field *> &aFields, const std::vector<uint> &aVersions)
+   {
+      uint tNumGeoms = aFields.size();
+      uint tNumClassified = gClassifiedVersions.size();
+
+      std::vector<uint> tChanged;
+      for (uint iG = 0; iG < tNumGeoms; iG++)
+      {
+         if (iG >= tNumClassified || aVersions[iG] != gClassifiedVersions[iG])
+         {
+            tChanged.push_back(iG);
+         }
+      }
+
+      if (gBitsetGrid.size() != NUM_POINTS * NUM_POINTS || tNumClassified > tNumGeoms || tChanged.size() == tNumGeoms)
+      {
+         classify_phases(aFields);
+      }
+      else
+      {
+         for (uint iG = tNumClassified; iG < tNumGeoms; iG++)
+         {
+            insert_classified_geometry(iG, iG + 1);
+         }
+         for (uint iG : tChanged)
+         {
+            reclassify_geometry(iG, tNumGeoms, *aFields[iG]);
+         }
+      }
+
+      gClassifiedVersions = aVersions;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Point of an interface root on the projection grid, from the roots solved for a field. Falls back to the middle of
+    * the edge if the root could not be solved
+    *
+    * @param aEdge Edge index, see edge_index
+    */
+   void edge_point(const Field &aField, size_t aEdge, double *aPoint)
+   {
+      const size_t tNumXEdges = (NUM_POINTS - 1) * NUM_POINTS;
+      double tRoot = aField.mRoots[aEdge];
+      if (aEdge < tNumXEdges)
+      {
+         int i = aEdge / NUM_POINTS;
+         int j = aEdge % NUM_POINTS;
+         aPoint[0] = std::isnan(tRoot) ? 0.5 * (gXVals[i] + gXVals[i + 1]) : tRoot;
+         aPoint[1] = gZVals[j];
+      }
+      else
+      {
+         int i = (aEdge - tNumXEdges) / (NUM_POINTS - 1);
+         int j = (aEdge - tNumXEdges) % (NUM_POINTS - 1);
+         aPoint[0] = gXVals[i];
+         aPoint[1] = std::isnan(tRoot) ? 0.5 * (gZVals[j] + gZVals[j + 1]) : tRoot;
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Splits a convex polygon of (x,z) pairs by the line through aP and aQ into the part left of the line, looking from aP
+    * to aQ, and the part right of it. Vertices on the line belong to both parts
+    */
+   void split_polygon(const std::vector<double> &aPolygon, const double *aP, const double *aQ,
+                      std::vector<double> &aLeft, std::vector<double> &aRight)
+   {
+      aLeft.clear();
+      aRight.clear();
+      size_t tNumVerts = aPolygon.size() / 2;
+      auto tSide = [&](size_t aVert)
+      {
+         const double *tV = &aPolygon[2 * aVert];
+         return (aQ[0] - aP[0]) * (tV[1] - aP[1]) - (aQ[1] - aP[1]) * (tV[0] - aP[0]);
+      };
+
+      for (size_t iV = 0; iV < tNumVerts; iV++)
+      {
+         size_t tNext = (iV + 1) % tNumVerts;
+         double d0 = tSide(iV);
+         double d1 = tSide(tNext);
+         const double *v0 = &aPolygon[2 * iV];
+         const double *v1 = &aPolygon[2 * tNext];
+         if (d0 >= 0)
+         {
+            aLeft.insert(aLeft.end(), {v0[0], v0[1]});
+         }
+         if (d0 <= 0)
+         {
+            aRight.insert(aRight.end(), {v0[0], v0[1]});
+         }
+         if ((d0 > 0 && d1 < 0) || (d0 < 0 && d1 > 0))
+         {
+            double t = d0 / (d0 - d1);
+            double x = v0[0] + t * (v1[0] - v0[0]);
+            double z = v0[1] + t * (v1[1] - v0[1]);
+            aLeft.insert(aLeft.end(), {x, z});
+            aRight.insert(aRight.end(), {x, z});
+         }
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Marching squares over the classified projection grid. Produces the interface polylines of every geometry in
+    * gInterfaces and the polygons of every bitset in gPhasePolygons, cells inside one bitset are merged into rectangles
+    * along z and cells crossed by interfaces are clipped by the interface segments of every geometry that changes sign in them.
+    * Crossings are solved on both x- and z-edges with edge_root and kept with the fields, so polylines and polygons
+    * share their vertices and nothing is solved again until a field changes. Saddle cells are decided by the value at
+    * the cell center. Row bands run on the thread pool, first solving the roots of the edges they own, then building
+    * their cells from the solved roots. Polygons are built for hidden bitsets too, so phase table edits only change what is drawn
+    */
+   void extract_interfaces(const std::vector<LS> &aLevelSets, const std::vector<const Field *> &aFields)
+   {
+      const int n = NUM_POINTS;
+      const uint tNumGeoms = aFields.size();
+      const uint tNumBitsets = 1u << tNumGeoms;
+      const uint tNumBands = (n - 1 + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+      const Bitset *tBitsets = gBitsetGrid.data();
+
+      // Roots of the crossed edges. A band owns the x- and z-edges starting on its vertex rows, the last band
+      // also owns the z-edges of the last row, so every root is solved by exactly one task
+      if (gIsocontour)
+      {
+         for (const Field *tField : aFields)
+         {
+            prepare_edge_roots(*tField);
+         }
+         thread_pool().parallel_for(tNumBands, [&](uint aBand)
+                                    {
+            int tRowBegin = aBand * ROWS_PER_TASK;
+            int tRowEnd = aBand + 1 == tNumBands ? n : std::min<int>(tRowBegin + ROWS_PER_TASK, n - 1);
+            for (int i = tRowBegin; i < tRowEnd; i++)
+            {
+               for (int j = 0; j < n; j++)
+               {
+                  Bitset b = tBitsets[i * n + j];
+                  Bitset tXFlips = i + 1 < n ? b ^ tBitsets[(i + 1) * n + j] : 0;
+                  Bitset tZFlips = j + 1 < n ? b ^ tBitsets[i * n + j + 1] : 0;
+                  for (uint iG = 0; iG < tNumGeoms; iG++)
+                  {
+                     Bitset tBit = geometry_bit(iG, tNumGeoms);
+                     if (tXFlips & tBit)
+                     {
+                        edge_root(aLevelSets[iG], *aFields[iG], 0, i, j);
+                     }
+                     if (tZFlips & tBit)
+                     {
+                        edge_root(aLevelSets[iG], *aFields[iG], 1, i, j);
+                     }
+                  }
+               }
+            } });
+      }
+
+      // Output of one band, merged in band order so the result does not depend on the scheduling
+      struct Band
+      {
+         std::vector<PolygonMesh> mPolygons;             // Polygons of every bitset
+         std::vector<std::vector<size_t>> mSegments;     // Interface segments of every geometry as pairs of edge indices
+      };
+      std::vector<Band> tBands(tNumBands);
+
+      thread_pool().parallel_for(tNumBands, [&](uint aBand)
+                                 {
+         Band &tBand = tBands[aBand];
+         tBand.mPolygons.resize(tNumBitsets);
+         tBand.mSegments.resize(tNumGeoms);
+
+         // A piece of a cell, with the bits of the geometries it has been clipped by so far
+         struct Piece
+         {
+            std::vector<double> mVertices;
+            Bitset mBitset;
+         };
+         std::vector<Piece> tPieces, tNextPieces;
+         std::vector<double> tLeft, tRight;
+
+         int tRowBegin = aBand * ROWS_PER_TASK;
+         int tRowEnd = std::min<int>(tRowBegin + ROWS_PER_TASK, n - 1);
+         for (int i = tRowBegin; i < tRowEnd; i++)
+         {
+            double x0 = gXVals[i];
+            double x1 = gXVals[i + 1];
+
+            // Runs of cells inside one bitset along z become one rectangle
+            int tRunStart = -1;
+            Bitset tRunBitset = 0;
+            auto tEndRun = [&](int aEnd)
+            {
+               if (tRunStart >= 0)
+               {
+                  double z0 = gZVals[tRunStart];
+                  double z1 = gZVals[aEnd];
+                  tBand.mPolygons[tRunBitset].add_polygon({x0, z0, x1, z0, x1, z1, x0, z1});
+                  tRunStart = -1;
+               }
+            };
+
+            for (int j = 0; j < n - 1; j++)
+            {
+               // Corners counterclockwise, c0 = [i][j], c1 = [i+1][j], c2 = [i+1][j+1], c3 = [i][j+1]
+               const Bitset b[4] = {tBitsets[i * n + j], tBitsets[(i + 1) * n + j], tBitsets[(i + 1) * n + j + 1], tBitsets[i * n + j + 1]};
+               Bitset tFlips = (b[0] ^ b[1]) | (b[0] ^ b[2]) | (b[0] ^ b[3]);
+               if (tFlips == 0)
+               {
+                  if (tRunStart >= 0 && tRunBitset != b[0])
+                  {
+                     tEndRun(j);
+                  }
+                  if (tRunStart < 0)
+                  {
+                     tRunStart = j;
+                     tRunBitset = b[0];
+                  }
+                  continue;
+               }
+               tEndRun(j);
+               if (!gIsocontour)
+               {
+                  continue; // Without the isocontour nothing is emitted along the interface
+               }
+
+               double z0 = gZVals[j];
+               double z1 = gZVals[j + 1];
+               const double tCorners[4][2] = {{x0, z0}, {x1, z0}, {x1, z1}, {x0, z1}};
+
+               // Edges between the corners, e0 = c0-c1, e1 = c1-c2, e2 = c3-c2, e3 = c0-c3
+               const size_t tEdges[4] = {edge_index(0, i, j, n), edge_index(1, i + 1, j, n),
+                                         edge_index(0, i, j + 1, n), edge_index(1, i, j, n)};
+               const int tEdgeCorners[4][2] = {{0, 1}, {1, 2}, {3, 2}, {0, 3}};
+
+               tPieces.assign(1, {{x0, z0, x1, z0, x1, z1, x0, z1}, static_cast<Bitset>(b[0] & ~tFlips)});
+               for (uint iG = 0; iG < tNumGeoms; iG++)
+               {
+                  Bitset tBit = geometry_bit(iG, tNumGeoms);
+                  if (!(tFlips & tBit))
+                  {
+                     continue;
+                  }
+                  bool tPositive[4];
+                  for (int iC = 0; iC < 4; iC++)
+                  {
+                     tPositive[iC] = b[iC] & tBit;
+                  }
+
+                  int tCrossed[4];
+                  int tNumCrossed = 0;
+                  for (int iE = 0; iE < 4; iE++)
+                  {
+                     if (tPositive[tEdgeCorners[iE][0]] != tPositive[tEdgeCorners[iE][1]])
+                     {
+                        tCrossed[tNumCrossed++] = iE;
+                     }
+                  }
+
+                  // Segments as pairs of crossed edges, with the corner on the side they isolate (-1 for none)
+                  int tSegments[2][2];
+                  int tIsolated[2];
+                  int tNumSegments = 1;
+                  if (tNumCrossed == 2)
+                  {
+                     tSegments[0][0] = tCrossed[0];
+                     tSegments[0][1] = tCrossed[1];
+                     tIsolated[0] = -1;
+                  }
+                  else
+                  {
+                     // Saddle, the corners with the sign of the center stay connected
+                     bool tCenter = eval_LS(aLevelSets[iG], 0.5 * (x0 + x1), 0.5 * (z0 + z1), gZ) >= 0;
+                     bool tCut02 = tPositive[0] != tCenter;
+                     const int tAround[4][2] = {{3, 0}, {0, 1}, {1, 2}, {2, 3}}; // Edges around each corner
+                     tNumSegments = 2;
+                     for (int iS = 0; iS < 2; iS++)
+                     {
+                        tIsolated[iS] = tCut02 ? 2 * iS : 2 * iS + 1;
+                        tSegments[iS][0] = tAround[tIsolated[iS]][0];
+                        tSegments[iS][1] = tAround[tIsolated[iS]][1];
+                     }
+                  }
+
+                  // Orients every segment with the positive side on its left, the isolated sides all have the same sign
+                  double tP[2][2], tQ[2][2];
+                  size_t tFrom[2], tTo[2];
+                  bool tIsolatedPositive = true;
+                  for (int iS = 0; iS < tNumSegments; iS++)
+                  {
+                     tFrom[iS] = tEdges[tSegments[iS][0]];
+                     tTo[iS] = tEdges[tSegments[iS][1]];
+                     edge_point(*aFields[iG], tFrom[iS], tP[iS]);
+                     edge_point(*aFields[iG], tTo[iS], tQ[iS]);
+
+                     // Side of the corner that is furthest from the segment among the ones that tell its orientation
+                     double tSide = 0.0;
+                     for (int iC = 0; iC < 4; iC++)
+                     {
+                        if (tIsolated[iS] >= 0 ? iC != tIsolated[iS] : !tPositive[iC])
+                        {
+                           continue;
+                        }
+                        double d = (tQ[iS][0] - tP[iS][0]) * (tCorners[iC][1] - tP[iS][1]) -
+                                   (tQ[iS][1] - tP[iS][1]) * (tCorners[iC][0] - tP[iS][0]);
+                        d = tPositive[iC] ? d : -d;
+                        tSide = std::abs(d) > std::abs(tSide) ? d : tSide;
+                     }
+                     if (tSide < 0)
+                     {
+                        std::swap(tP[iS], tQ[iS]);
+                        std::swap(tFrom[iS], tTo[iS]);
+                     }
+                     tIsolatedPositive = tIsolated[iS] >= 0 ? tPositive[tIsolated[iS]] : true;
+                     tBand.mSegments[iG].insert(tBand.mSegments[iG].end(), {tFrom[iS], tTo[iS]});
+                  }
+
+                  // Each segment cuts off the side it isolates, what is left over has the other sign
+                  Bitset tIsolatedBit = tIsolatedPositive ? tBit : 0;
+                  Bitset tRemainderBit = tIsolatedPositive ? 0 : tBit;
+                  tNextPieces.clear();
+                  for (Piece &tPiece : tPieces)
+                  {
+                     for (int iS = 0; iS < tNumSegments && tPiece.mVertices.size() >= 6; iS++)
+                     {
+                        split_polygon(tPiece.mVertices, tP[iS], tQ[iS], tLeft, tRight);
+                        std::vector<double> &tCut = tIsolatedPositive ? tLeft : tRight;
+                        if (tCut.size() >= 6)
+                        {
+                           tNextPieces.push_back({tCut, static_cast<Bitset>(tPiece.mBitset | tIsolatedBit)});
+                        }
+                        tPiece.mVertices.swap(tIsolatedPositive ? tRight : tLeft);
+                     }
+                     if (tPiece.mVertices.size() >= 6)
+                     {
+                        tNextPieces.push_back({std::move(tPiece.mVertices), static_cast<Bitset>(tPiece.mBitset | tRemainderBit)});
+                     }
+                  }
+                  tPieces.swap(tNextPieces);
+               }
+
+               for (const Piece &tPiece : tPieces)
+               {
+                  tBand.mPolygons[tPiece.mBitset].add_polygon(tPiece.mVertices);
+               }
+            }
+            tEndRun(n - 1);
+         } });
+
+      for (uint iB = 0; iB < tNumBitsets; iB++)
+      {
+         gPhasePolygons[iB].clear();
+         for (const Band &tBand : tBands)
+         {
+            gPhasePolygons[iB].append(tBand.mPolygons[iB]);
+         }
+      }
+
+      // Polylines, numbering the vertices by their first use and chaining the oriented segments through them
+      std::vector<uint> tVertexOf(2 * (n - 1) * n, MORIS_UINT_MAX);
+      std::vector<uint> tNext, tPrevious;
+      std::vector<bool> tVisited;
+      for (uint iG = 0; iG < tNumGeoms; iG++)
+      {
+         InterfaceCurves &tCurves = gInterfaces[iG];
+         tCurves.clear();
+         tNext.clear();
+         tPrevious.clear();
+
+         auto tVertex = [&](size_t aEdge)
+         {
+            if (tVertexOf[aEdge] == MORIS_UINT_MAX)
+            {
+               tVertexOf[aEdge] = tCurves.num_vertices();
+               double tPoint[2];
+               edge_point(*aFields[iG], aEdge, tPoint);
+               tCurves.mVertices.insert(tCurves.mVertices.end(), {tPoint[0], tPoint[1]});
+               tNext.push_back(MORIS_UINT_MAX);
+               tPrevious.push_back(MORIS_UINT_MAX);
+            }
+            return tVertexOf[aEdge];
+         };
+
+         for (const Band &tBand : tBands)
+         {
+            const std::vector<size_t> &tSegments = tBand.mSegments[iG];
+            for (size_t iS = 0; iS < tSegments.size(); iS += 2)
+            {
+               uint tFrom = tVertex(tSegments[iS]);
+               uint tTo = tVertex(tSegments[iS + 1]);
+               tNext[tFrom] = tTo;
+               tPrevious[tTo] = tFrom;
+            }
+         }
+
+         // Open polylines start where no segment ends, the vertices left over lie on closed ones
+         uint tNumVerts = tCurves.num_vertices();
+         tVisited.assign(tNumVerts, false);
+         for (int iPass = 0; iPass < 2; iPass++)
+         {
+            for (uint iV = 0; iV < tNumVerts; iV++)
+            {
+               if (tVisited[iV] || (iPass == 0 && tPrevious[iV] != MORIS_UINT_MAX))
+               {
+                  continue;
+               }
+               tCurves.mPolylineStarts.push_back(tCurves.mIndices.size());
+               uint tV = iV;
+               while (tV != MORIS_UINT_MAX && !tVisited[tV])
+               {
+                  tVisited[tV] = true;
+                  tCurves.mIndices.push_back(tV);
+                  tV = tNext[tV];
+               }
+               if (tV == iV)
+               {
+                  tCurves.mIndices.push_back(iV);
+               }
+            }
+         }
+
+         for (const Band &tBand : tBands)
+         {
+            for (size_t tEdge : tBand.mSegments[iG])
+            {
+               tVertexOf[tEdge] = MORIS_UINT_MAX;
+            }
+         }
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Chains oriented segments between the vertices of aCurves into its polylines. Every vertex must start and end at most
+    * one segment, open polylines start where no segment ends and the vertices left over lie on closed polylines
+    *
+    * @param aSegments Pairs of vertex indices, from the start to the end of each segment
+    */
+   void chain_polylines(const std::vector<uint> &aSegments, InterfaceCurves &aCurves)
+   {
+      uint tNumVerts = aCurves.num_vertices();
+      std::vector<uint> tNext(tNumVerts, MORIS_UINT_MAX);
+      std::vector<uint> tPrevious(tNumVerts, MORIS_UINT_MAX);
+      for (size_t iS = 0; iS < aSegments.size(); iS += 2)
+      {
+         tNext[aSegments[iS]] = aSegments[iS + 1];
+         tPrevious[aSegments[iS + 1]] = aSegments[iS];
+      }
+
+      aCurves.mIndices.clear();
+      aCurves.mPolylineStarts.clear();
+      std::vector<bool> tVisited(tNumVerts, false);
+      for (int iPass = 0; iPass < 2; iPass++)
+      {
+         for (uint iV = 0; iV < tNumVerts; iV++)
+         {
+            if (tVisited[iV] || (iPass == 0 && tPrevious[iV] != MORIS_UINT_MAX))
+            {
+               continue;
+            }
+            aCurves.mPolylineStarts.push_back(aCurves.mIndices.size());
+            uint tV = iV;
+            while (tV != MORIS_UINT_MAX && !tVisited[tV])
+            {
+               tVisited[tV] = true;
+               aCurves.mIndices.push_back(tV);
+               tV = tNext[tV];
+            }
+            if (tV == iV)
+            {
+               aCurves.mIndices.push_back(iV);
+            }
+         }
+      }
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Samples a level-set on the slice and domain of aInterface.mKey with an adaptive quadtree and extracts its interface.
+    * The quadtree starts from 2^QUADTREE_BASE cells in each direction, and cells are split down to level aInterface.mDepth
+    * if their corners differ in sign, or if the value at their center is within QUADTREE_MARGIN of what the interface
+    * could reach across half the cell diagonal, from the gradient estimated at the corners plus the deviation of the
+    * center from the corner average. A cell whose edge has a point of a finer neighbor with another sign is split too.
+    * All points lie on the lattice of the finest level and are sampled once, level by level, in one batch per level on
+    * the calling thread, which is the background refiner's. aInterface.mMilliseconds gets the time it all took.
+    * The interface crosses the boundaries of the leaves, through the points their finer neighbors added on their edges,
+    * where consecutive points differ in sign, at the linear interpolation of the two values. Both leaves of an edge
+    * share the crossing, so the polylines are closed wherever the interface is
+    */
+   void refine_interface(const LS &aLS, RefinedInterface &aInterface)
+   {
+      auto tStart = std::chrono::steady_clock::now();
+      const FieldKey &tDomain = aInterface.mKey;
+      const int tDepth = aInterface.mDepth;
+      const int tBase = std::min(QUADTREE_BASE, tDepth);
+      const std::uint64_t tSide = (1ull << tDepth) + 1; // Lattice points in each direction
+      const double tDX = (tDomain.mXUB - tDomain.mXLB) / (tSide - 1);
+      const double tDY = (tDomain.mZUB - tDomain.mZLB) / (tSide - 1);
+
+      aInterface.mSamples = 0;
+      aInterface.mCurves.clear();
+
+      std::unordered_map<std::uint64_t, double> tValues;
+      auto tKey = [&](std::uint64_t ix, std::uint64_t iy)
+      {
+         return ix * tSide + iy;
+      };
+      auto tValue = [&](std::uint64_t ix, std::uint64_t iy)
+      {
+         return tValues.find(tKey(ix, iy))->second;
+      };
+
+      // Points waiting to be sampled, evaluated together by tSample
+      std::vector<std::uint64_t> tPending;
+      auto tRequest = [&](std::uint64_t ix, std::uint64_t iy)
+      {
+         if (tValues.emplace(tKey(ix, iy), 0.0).second)
+         {
+            tPending.push_back(tKey(ix, iy));
+         }
+      };
+      auto tSample = [&]()
+      {
+         size_t tCount = tPending.size();
+         std::vector<double> tXs(tCount), tYs(tCount), tZs(tCount, tDomain.mSlice), tPhi(tCount);
+         for (size_t iP = 0; iP < tCount; iP++)
+         {
+            tXs[iP] = tDomain.mXLB + (tPending[iP] / tSide) * tDX;
+            tYs[iP] = tDomain.mZLB + (tPending[iP] % tSide) * tDY;
+         }
+         {
+            // Parameter changes wait for the batch, like they wait for a field of the slice sampler
+            std::lock_guard<std::mutex> tValuesLock(gParameterValuesMutex);
+            eval_LS_batch(aLS, tXs.data(), tYs.data(), tZs.data(), tPhi.data(), tCount);
+         }
+         for (size_t iP = 0; iP < tCount; iP++)
+         {
+            tValues.find(tPending[iP])->second = tPhi[iP];
+         }
+         aInterface.mSamples += tCount;
+         tPending.clear();
+      };
+
+      // Cells by their lattice corner and level, the leaves are kept for the extraction
+      struct Cell
+      {
+         std::uint32_t mX, mY;
+         int mLevel;
+      };
+      std::vector<Cell> tCells, tChildren, tLeaves;
+      std::uint32_t tBaseSize = 1u << (tDepth - tBase);
+      for (std::uint32_t ix = 0; ix <= (1u << tBase); ix++)
+      {
+         for (std::uint32_t iy = 0; iy <= (1u << tBase); iy++)
+         {
+            tRequest(ix * tBaseSize, iy * tBaseSize);
+            if (ix < (1u << tBase) && iy < (1u << tBase))
+            {
+               tCells.push_back({ix * tBaseSize, iy * tBaseSize, tBase});
+            }
+         }
+      }
+      tSample();
+
+      for (int iLevel = tBase; iLevel < tDepth && !tCells.empty(); iLevel++)
+      {
+         std::uint32_t s = 1u << (tDepth - iLevel);
+         std::uint32_t h = s / 2;
+         std::vector<char> tSplit(tCells.size(), 0);
+         auto tCorners = [&](const Cell &aCell, double *aPhi)
+         {
+            aPhi[0] = tValue(aCell.mX, aCell.mY);
+            aPhi[1] = tValue(aCell.mX + s, aCell.mY);
+            aPhi[2] = tValue(aCell.mX + s, aCell.mY + s);
+            aPhi[3] = tValue(aCell.mX, aCell.mY + s);
+         };
+
+         // Cells with a sign change are split, the others need their center to tell
+         for (size_t iC = 0; iC < tCells.size(); iC++)
+         {
+            double c[4];
+            tCorners(tCells[iC], c);
+            tSplit[iC] = (c[0] >= 0) != (c[1] >= 0) || (c[0] >= 0) != (c[2] >= 0) || (c[0] >= 0) != (c[3] >= 0);
+            if (!tSplit[iC])
+            {
+               tRequest(tCells[iC].mX + h, tCells[iC].mY + h);
+            }
+         }
+         tSample();
+
+         const double tHalfDiagonal = 0.5 * s * std::hypot(tDX, tDY);
+         for (size_t iC = 0; iC < tCells.size(); iC++)
+         {
+            if (tSplit[iC])
+            {
+               continue;
+            }
+            double c[4];
+            tCorners(tCells[iC], c);
+            double m = tValue(tCells[iC].mX + h, tCells[iC].mY + h);
+            double tGradX = (c[1] - c[0] + c[2] - c[3]) / (2.0 * s * tDX);
+            double tGradY = (c[3] - c[0] + c[2] - c[1]) / (2.0 * s * tDY);
+            double tBend = std::abs(m - 0.25 * (c[0] + c[1] + c[2] + c[3]));
+            tSplit[iC] = (m >= 0) != (c[0] >= 0) || std::abs(m) < QUADTREE_MARGIN * (tHalfDiagonal * std::hypot(tGradX, tGradY) + tBend);
+         }
+
+         // Sample the points of the split cells, then split the cells their new edge points changed sign on, until none is left
+         std::vector<char> tSampled(tCells.size(), 0);
+         bool tChanged = true;
+         while (tChanged)
+         {
+            for (size_t iC = 0; iC < tCells.size(); iC++)
+            {
+               if (tSplit[iC] && !tSampled[iC])
+               {
+                  const Cell &tCell = tCells[iC];
+                  tRequest(tCell.mX + h, tCell.mY);
+                  tRequest(tCell.mX + s, tCell.mY + h);
+                  tRequest(tCell.mX + h, tCell.mY + s);
+                  tRequest(tCell.mX, tCell.mY + h);
+                  tRequest(tCell.mX + h, tCell.mY + h);
+                  tSampled[iC] = true;
+               }
+            }
+            tSample();
+
+            tChanged = false;
+            for (size_t iC = 0; iC < tCells.size(); iC++)
+            {
+               if (tSplit[iC])
+               {
+                  continue;
+               }
+               const Cell &tCell = tCells[iC];
+               bool tPositive = tValue(tCell.mX, tCell.mY) >= 0;
+               const std::uint64_t tMidpoints[4] = {tKey(tCell.mX + h, tCell.mY), tKey(tCell.mX + s, tCell.mY + h),
+                                                    tKey(tCell.mX + h, tCell.mY + s), tKey(tCell.mX, tCell.mY + h)};
+               for (std::uint64_t tMidpoint : tMidpoints)
+               {
+                  auto tFound = tValues.find(tMidpoint);
+                  if (tFound != tValues.end() && (tFound->second >= 0) != tPositive)
+                  {
+                     tSplit[iC] = true;
+                     tChanged = true;
+                     break;
+                  }
+               }
+            }
+         }
+
+         tChildren.clear();
+         for (size_t iC = 0; iC < tCells.size(); iC++)
+         {
+            const Cell &tCell = tCells[iC];
+            if (!tSplit[iC])
+            {
+               tLeaves.push_back(tCell);
+               continue;
+            }
+            for (std::uint32_t iChild = 0; iChild < 4; iChild++)
+            {
+               tChildren.push_back({tCell.mX + (iChild & 1) * h, tCell.mY + (iChild >> 1) * h, iLevel + 1});
+            }
+         }
+         tCells.swap(tChildren);
+      }
+      tLeaves.insert(tLeaves.end(), tCells.begin(), tCells.end());
+
+      // Crossings between two lattice points, numbered in the order they are found
+      InterfaceCurves &tCurves = aInterface.mCurves;
+      std::unordered_map<std::uint64_t, uint> tCrossings;
+      auto tCrossing = [&](std::uint64_t a, std::uint64_t b)
+      {
+         if (a > b)
+         {
+            std::swap(a, b);
+         }
+         auto tInserted = tCrossings.emplace(a << 32 | b, tCurves.num_vertices());
+         if (tInserted.second)
+         {
+            double tPhiA = tValues.find(a)->second;
+            double tPhiB = tValues.find(b)->second;
+            double t = tPhiA / (tPhiA - tPhiB);
+            t = t >= 0.0 && t <= 1.0 ? t : 0.5;
+            double xa = tDomain.mXLB + (a / tSide) * tDX, ya = tDomain.mZLB + (a % tSide) * tDY;
+            double xb = tDomain.mXLB + (b / tSide) * tDX, yb = tDomain.mZLB + (b % tSide) * tDY;
+            tCurves.mVertices.insert(tCurves.mVertices.end(), {xa + t * (xb - xa), ya + t * (yb - ya)});
+         }
+         return tInserted.first->second;
+      };
+
+      // Points finer neighbors added on the edge from a to b, in order from a, found by halving the edge
+      std::vector<std::uint64_t> tBoundary;
+      auto tEdgePoints = [&](auto &aSelf, std::uint32_t ax, std::uint32_t ay, std::uint32_t bx, std::uint32_t by) -> void
+      {
+         std::uint32_t mx = (ax + bx) / 2;
+         std::uint32_t my = (ay + by) / 2;
+         if (std::max(ax, bx) - std::min(ax, bx) + std::max(ay, by) - std::min(ay, by) < 2 || tValues.find(tKey(mx, my)) == tValues.end())
+         {
+            return;
+         }
+         aSelf(aSelf, ax, ay, mx, my);
+         tBoundary.push_back(tKey(mx, my));
+         aSelf(aSelf, mx, my, bx, by);
+      };
+
+      std::vector<uint> tSegments;
+      std::vector<bool> tPositive;
+      for (const Cell &tLeaf : tLeaves)
+      {
+         // Boundary counterclockwise, with the positive side of every segment on its left
+         std::uint32_t s = 1u << (tDepth - tLeaf.mLevel);
+         const std::uint32_t tCorners[4][2] = {{tLeaf.mX, tLeaf.mY}, {tLeaf.mX + s, tLeaf.mY}, {tLeaf.mX + s, tLeaf.mY + s}, {tLeaf.mX, tLeaf.mY + s}};
+         tBoundary.clear();
+         for (int iC = 0; iC < 4; iC++)
+         {
+            tBoundary.push_back(tKey(tCorners[iC][0], tCorners[iC][1]));
+            tEdgePoints(tEdgePoints, tCorners[iC][0], tCorners[iC][1], tCorners[(iC + 1) % 4][0], tCorners[(iC + 1) % 4][1]);
+         }
+
+         size_t tNumPoints = tBoundary.size();
+         tPositive.resize(tNumPoints);
+         bool tMixed = false;
+         for (size_t iP = 0; iP < tNumPoints; iP++)
+         {
+            tPositive[iP] = tValues.find(tBoundary[iP])->second >= 0;
+            tMixed = tMixed || tPositive[iP] != tPositive[0];
+         }
+         if (!tMixed)
+         {
+            continue;
+         }
+
+         // Every piece of the boundary that leaves the positive side is joined to the one that entered it before,
+         // which keeps the positive sides of ambiguous leaves apart
+         for (size_t iP = 0; iP < tNumPoints; iP++)
+         {
+            size_t tNextP = (iP + 1) % tNumPoints;
+            if (!tPositive[iP] || tPositive[tNextP])
+            {
+               continue;
+            }
+            for (size_t iBack = 1; iBack < tNumPoints; iBack++)
+            {
+               size_t e = (iP + tNumPoints - iBack) % tNumPoints;
+               if (!tPositive[e] && tPositive[(e + 1) % tNumPoints])
+               {
+                  uint tFrom = tCrossing(tBoundary[iP], tBoundary[tNextP]);
+                  uint tTo = tCrossing(tBoundary[e], tBoundary[(e + 1) % tNumPoints]);
+                  tSegments.insert(tSegments.end(), {tFrom, tTo});
+                  break;
+               }
+            }
+         }
+      }
+      chain_polylines(tSegments, tCurves);
+      aInterface.mMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Background refinement of the overlay interfaces. Every frame with the overlay on submits the level-sets being
+    * shown, and the worker refines the ones whose interface at the current slice, parameters and depth isn't done yet.
+    * Finished interfaces stay until QUADTREE_CACHE_SIZE newer ones push them out, so going back to a depth or slice
+    * takes no refinement. The worker has its own thread, so the GLUT thread keeps drawing the last interfaces meanwhile
+    */
+   class InterfaceRefiner
+   {
+    public:
+      InterfaceRefiner()
+          : mDone(QUADTREE_CACHE_SIZE), mWorker(&InterfaceRefiner::worker_loop, this)
+      {
+      }
+
+      ~InterfaceRefiner()
+      {
+         {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+         }
+         mWake.notify_all();
+         mWorker.join();
+      }
+
+      /**
+       * Queues the interfaces of aLevelSets on the current slice at depth aDepth that are neither refined nor being
+       * refined, replacing what earlier frames queued. Called once per frame
+       */
+      void submit(const std::vector<const LS *> &aLevelSets, int aDepth)
+      {
+         std::vector<Job> tJobs;
+         for (const LS *tLS : aLevelSets)
+         {
+            tJobs.push_back({*tLS, field_key(*tLS, 1, SAMPLING::VALUES, gZ)});
+         }
+
+         std::lock_guard<std::mutex> lock(mMutex);
+         mQueue.clear();
+         for (Job &tJob : tJobs)
+         {
+            bool tDone = (aDepth == mBusyDepth && tJob.mKey == mBusy) ||
+                         std::any_of(mDone.begin(), mDone.end(), [&tJob, aDepth](const RefinedInterface &aInterface)
+                                     { return aInterface.mDepth == aDepth && aInterface.mKey == tJob.mKey; });
+            if (!tDone)
+            {
+               tJob.mDepth = aDepth;
+               mQueue.push_back(std::move(tJob));
+            }
+         }
+         mWake.notify_all();
+      }
+
+      /**
+       * Copies the refined interface with key aKey at depth aDepth into aInterface, returns false if there is none yet
+       */
+      bool get(const FieldKey &aKey, int aDepth, RefinedInterface &aInterface)
+      {
+         std::lock_guard<std::mutex> lock(mMutex);
+         for (RefinedInterface &tInterface : mDone)
+         {
+            if (tInterface.mDepth == aDepth && tInterface.mKey == aKey)
+            {
+               tInterface.mLastUsed = ++mUses;
+               aInterface = tInterface;
+               return true;
+            }
+         }
+         return false;
+      }
+
+    private:
+      // An interface to refine
+      struct Job
+      {
+         LS mLS;
+         FieldKey mKey;
+         int mDepth = 0;
+      };
+
+      void worker_loop()
+      {
+         while (true)
+         {
+            Job tJob;
+            {
+               std::unique_lock<std::mutex> lock(mMutex);
+               mWake.wait(lock, [this]()
+                          { return mStop || !mQueue.empty(); });
+               if (mStop)
+               {
+                  return;
+               }
+               tJob = std::move(mQueue.front());
+               mQueue.erase(mQueue.begin());
+               mBusy = tJob.mKey;
+               mBusyDepth = tJob.mDepth;
+            }
+
+            RefinedInterface tInterface;
+            tInterface.mKey = tJob.mKey;
+            tInterface.mDepth = tJob.mDepth;
+            refine_interface(tJob.mLS, tInterface);
+
+            // Keep the interface only if the domain and parameters didn't change while it was refined
+            bool tCurrent;
+            {
+               std::lock_guard<std::mutex> tValuesLock(gParameterValuesMutex);
+               tCurrent = field_key(tJob.mLS, 1, SAMPLING::VALUES, tJob.mKey.mSlice) == tJob.mKey;
+            }
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBusy = FieldKey{};
+            mBusyDepth = 0;
+            if (tCurrent)
+            {
+               RefinedInterface *tOldest = &*std::min_element(mDone.begin(), mDone.end(), [](const RefinedInterface &aFirst, const RefinedInterface &aSecond)
+                                                              { return aFirst.mLastUsed < aSecond.mLastUsed; });
+               *tOldest = std::move(tInterface);
+               tOldest->mLastUsed = ++mUses;
+            }
+         }
+      }
+
+      std::vector<RefinedInterface> mDone; // Refined interfaces, the least recently used one is replaced first
+      std::vector<Job> mQueue;             // Interfaces still to refine
+      FieldKey mBusy{};                    // Key of the interface the worker is refining
+      int mBusyDepth = 0;                  // Its depth, 0 when the worker is idle
+      uint mUses = 0;                      // Counts refinements and lookups to order mDone by use
+      std::mutex mMutex;                   // Protects everything
+      std::condition_variable mWake;       // Wakes the worker when there is work or on shutdown
+      bool mStop = false;                  // Set when the refiner shuts down
+      std::thread mWorker;                 // Started last, once the members it uses exist
+   };
+
+   /**
+    * Gets the background interface refiner, started on first use
+    */
+   InterfaceRefiner &interface_refiner()
+   {
+      static InterfaceRefiner tRefiner;
+      return tRefiner;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Brings the overlay interfaces in gRefinedShown up to date with what the refiner has done, and asks it for the
+    * ones still missing. A geometry keeps showing its last interface until the one for the current slice, parameters
+    * and depth is ready
+    */
+   void update_refined_overlay()
+   {
+      std::vector<const LS *> tLevelSets;
+      gRefinedSamples = 0;
+      gRefinedMilliseconds = 0.0;
+      gRefinedPending = false;
+      for (uint iG = 0; iG < MAX_GEOMETRIES; iG++)
+      {
+         RefinedInterface &tShown = gRefinedShown[iG];
+         if (iG >= gNumGeoms)
+         {
+            tShown = RefinedInterface{};
+            continue;
+         }
+
+         FieldKey tKey = field_key(gLevelSets[iG], 1, SAMPLING::VALUES, gZ);
+         if (!(tShown.mDepth == gQuadtreeDepth && tShown.mKey == tKey))
+         {
+            gRefinedPending |= !interface_refiner().get(tKey, gQuadtreeDepth, tShown);
+            tLevelSets.push_back(&gLevelSets[iG]);
+         }
+         gRefinedSamples += tShown.mSamples;
+         gRefinedMilliseconds += tShown.mMilliseconds;
+      }
+      interface_refiner().submit(tLevelSets, gQuadtreeDepth);
+   }
+   //-----------------------------------------------------------------------
+
+   /**
+    * Brings the interfaces and phase polygons up to date. Fields come from the field cache, the bits of a geometry in the grid
+    * are only rewritten when its field changed and the interfaces are only extracted again when the classification or
+    * isocontour flag changed. Phase table and visibility changes don't get here, they only pick the polygons drawn and their colors
+    */
+   void update_interfaces()
+   {
+      std::vector<const LS *> tLevelSets(gNumGeoms);
+      for (uint iG = 0; iG < gNumGeoms; iG++)
+      {
+         tLevelSets[iG] = &gLevelSets[iG];
+      }
+
+      // Nothing the fields or interfaces depend on changed since the last frame
+      std::vector<uint> tGenerations = gScene.generations({SCENE::GEOMETRY, SCENE::PARAMETERS, SCENE::SLICE, SCENE::ISOCONTOUR});
+      if (gInterfacesValid && tGenerations == gInterfacesGenerations &&
+          reuse_fields(tLevelSets, 1, SAMPLING::SIGNS, gInterfacesFields, gClassifiedVersions))
+      {
+         return;
+      }
+
+      std::vector<const Field *> tFields = get_fields(tLevelSets, 1, SAMPLING::SIGNS);
+      std::vector<uint> tVersions(gNumGeoms);
+      for (uint iG = 0; iG < gNumGeoms; iG++)
+      {
+         tVersions[iG] = tFields[iG]->mVersion;
+      }
+
+      if (tVersions != gClassifiedVersions)
+      {
+         update_classification(tFields, tVersions);
+         gInterfacesValid = false;
+      }
+
+      if (!gInterfacesValid || gIsocontour != gInterfacesIsocontour)
+      {
+         extract_interfaces(gLevelSets, tFields);
+         gInterfacesIsocontour = gIsocontour;
+         gInterfacesValid = true;
+      }
+      gInterfacesFields = tFields;
+      gInterfacesGenerations = tGenerations;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Whether each bitset belongs to a phase in the list to plot, only determined again after the phases or geometries changed
+    */
+   const std::vector<bool> &visible_bitsets()
+   {
+      std::vector<uint> tGenerations = gScene.generations({SCENE::GEOMETRY, SCENE::PHASES});
+      if (tGenerations != gVisibleGenerations)
+      {
+         std::lock_guard<std::mutex> lock(gPhaseTableMutex);
+         gVisibleBitsets.assign(1 << gNumGeoms, false);
+         for (size_t iBitset = 0; iBitset < gVisibleBitsets.size(); iBitset++)
+         {
+            gVisibleBitsets[iBitset] = std::find(gPhasesToPlot.begin(), gPhasesToPlot.end(), gPhaseTable[iBitset]) != gPhasesToPlot.end();
+         }
+         gVisibleGenerations = tGenerations;
+      }
+      return gVisibleBitsets;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Draws the polygons extracted for a single bitset in the projection view, each as a fan of triangles
+    */
+   void draw_LS_projection(uint aBitset, int aColorIndex, uint aTexture = MORIS_UINT_MAX)
+   {
+      // Check if this phase has a projection texture
+      if (aTexture != MORIS_UINT_MAX)
+      {
+         glEnable(GL_TEXTURE_2D);
+         glBindTexture(GL_TEXTURE_2D, aTexture);
+         glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+      }
+
+      glPushMatrix();
+
+      glColor3d(gColors[aColorIndex][0], gColors[aColorIndex][1], gColors[aColorIndex][2]);
+
+      const PolygonMesh &tPolygons = gPhasePolygons[aBitset];
+
+      // Emit vertices with their texture coordinates
+      auto tVertex = [&](uint aVert)
+      {
+         double x = tPolygons.mVertices[2 * aVert];
+         double z = tPolygons.mVertices[2 * aVert + 1];
+         double xi = (x - gXLB) / (gXUB - gXLB) - gScroll * 0.01;
+         double eta = (z - gZLB) / (gZUB - gZLB);
+
+         glTexCoord2d(gXUB - xi, eta);
+         glVertex3d(x, 0.0, z);
+      };
+
+      glBegin(GL_TRIANGLES);
+      for (uint iP = 0; iP < tPolygons.num_polygons(); iP++)
+      {
+         uint tFirst = tPolygons.mPolygonStarts[iP];
+         for (uint iV = tFirst + 1; iV + 1 < tPolygons.polygon_end(iP); iV++)
+         {
+            tVertex(tFirst);
+            tVertex(iV);
+            tVertex(iV + 1);
+         }
+      }
+      glEnd();
+
+      // Unbind texture
+      if (aTexture != MORIS_UINT_MAX)
+      {
+         glBindTexture(GL_TEXTURE_2D, 0);
+         glDisable(GL_TEXTURE_2D);
+      }
+
+      ErrCheck("draw_LS_projection");
+
+      glPopMatrix();
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Draws the quadtree interfaces of the geometries being plotted over the phases in the projection view, when the
+    * overlay is on
+    */
+   void draw_interface_curves()
+   {
+      if (!gRefinedOverlay)
+      {
+         return;
+      }
+
+      glColor3f(1.0, 1.0, 1.0);
+      for (uint iG = 0; iG < gNumGeoms; iG++)
+      {
+         if (gGeomsPhaseToPlot[iG] == PHASE::NONE)
+         {
+            continue;
+         }
+
+         const InterfaceCurves &tCurves = gRefinedShown[iG].mCurves;
+         for (uint iL = 0; iL < tCurves.num_polylines(); iL++)
+         {
+            glBegin(GL_LINE_STRIP);
+            for (uint iV = tCurves.mPolylineStarts[iL]; iV < tCurves.polyline_end(iL); iV++)
+            {
+               glVertex3d(tCurves.mVertices[2 * tCurves.mIndices[iV]], 0.0, tCurves.mVertices[2 * tCurves.mIndices[iV] + 1]);
+            }
+            glEnd();
+         }
+      }
+
+      ErrCheck("draw_interface_curves");
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Writes the extracted interfaces and phase polygons of the current z-slice to a legacy VTK polydata file, in level-set
+    * coordinates. Lines carry the index of their geometry, polygons their bitset and phase, the other field is -1
+    */
+   bool export_interfaces(const std::string &aPath)
+   {
+      std::ofstream tFile(aPath);
+      if (!tFile)
+      {
+         return false;
+      }
+
+      std::vector<int> tPhaseTable;
+      {
+         std::lock_guard<std::mutex> lock(gPhaseTableMutex);
+         tPhaseTable = gPhaseTable;
+      }
+
+      uint tNumBitsets = 1u << gNumGeoms;
+      size_t tNumPoints = 0, tNumLines = 0, tLineSize = 0, tNumPolygons = 0, tPolygonSize = 0;
+      for (uint iG = 0; iG < gNumGeoms; iG++)
+      {
+         tNumPoints += gInterfaces[iG].num_vertices();
+         tNumLines += gInterfaces[iG].num_polylines();
+         tLineSize += gInterfaces[iG].num_polylines() + gInterfaces[iG].mIndices.size();
+      }
+      for (uint iB = 0; iB < tNumBitsets; iB++)
+      {
+         tNumPoints += gPhasePolygons[iB].num_vertices();
+         tNumPolygons += gPhasePolygons[iB].num_polygons();
+         tPolygonSize += gPhasePolygons[iB].num_polygons() + gPhasePolygons[iB].num_vertices();
+      }
+
+      tFile.precision(17);
+      tFile << "# vtk DataFile Version 3.0\n"
+            << "Level-set interfaces and phases at z = " << gZ << "\n"
+            << "ASCII\nDATASET POLYDATA\n"
+            << "POINTS " << tNumPoints << " double\n";
+      for (uint iG = 0; iG < gNumGeoms; iG++)
+      {
+         const std::vector<double> &tVertices = gInterfaces[iG].mVertices;
+         for (size_t iV = 0; iV < tVertices.size(); iV += 2)
+         {
+            tFile << tVertices[iV] << " " << tVertices[iV + 1] << " " << gZ << "\n";
+         }
+      }
+      for (uint iB = 0; iB < tNumBitsets; iB++)
+      {
+         const std::vector<double> &tVertices = gPhasePolygons[iB].mVertices;
+         for (size_t iV = 0; iV < tVertices.size(); iV += 2)
+         {
+            tFile << tVertices[iV] << " " << tVertices[iV + 1] << " " << gZ << "\n";
+         }
+      }
+
+      // Connectivity, points are numbered in the order they were written
+      size_t tOffset = 0;
+      tFile << "LINES " << tNumLines << " " << tLineSize << "\n";
+      for (uint iG = 0; iG < gNumGeoms; iG++)
+      {
+         const InterfaceCurves &tCurves = gInterfaces[iG];
+         for (uint iL = 0; iL < tCurves.num_polylines(); iL++)
+         {
+            tFile << tCurves.polyline_end(iL) - tCurves.mPolylineStarts[iL];
+            for (uint iI = tCurves.mPolylineStarts[iL]; iI < tCurves.polyline_end(iL); iI++)
+            {
+               tFile << " " << tOffset + tCurves.mIndices[iI];
+            }
+            tFile << "\n";
+         }
+         tOffset += tCurves.num_vertices();
+      }
+      tFile << "POLYGONS " << tNumPolygons << " " << tPolygonSize << "\n";
+      for (uint iB = 0; iB < tNumBitsets; iB++)
+      {
+         const PolygonMesh &tPolygons = gPhasePolygons[iB];
+         for (uint iP = 0; iP < tPolygons.num_polygons(); iP++)
+         {
+            tFile << tPolygons.polygon_end(iP) - tPolygons.mPolygonStarts[iP];
+            for (uint iV = tPolygons.mPolygonStarts[iP]; iV < tPolygons.polygon_end(iP); iV++)
+            {
+               tFile << " " << tOffset + iV;
+            }
+            tFile << "\n";
+         }
+         tOffset += tPolygons.num_vertices();
+      }
+
+      // Cell data, lines come before polygons
+      tFile << "CELL_DATA " << tNumLines + tNumPolygons << "\n";
+      const char *tNames[3] = {"geometry", "bitset", "phase"};
+      for (int iField = 0; iField < 3; iField++)
+      {
+         tFile << "SCALARS " << tNames[iField] << " int 1\nLOOKUP_TABLE default\n";
+         for (uint iG = 0; iG < gNumGeoms; iG++)
+         {
+            for (uint iL = 0; iL < gInterfaces[iG].num_polylines(); iL++)
+            {
+               tFile << (iField == 0 ? int(iG) : -1) << "\n";
+            }
+         }
+         for (uint iB = 0; iB < tNumBitsets; iB++)
+         {
+            int tValue = iField == 0 ? -1 : iField == 1 ? int(iB) : tPhaseTable[iB];
+            for (uint iP = 0; iP < gPhasePolygons[iB].num_polygons(); iP++)
+            {
+               tFile << tValue << "\n";
+            }
+         }
+      }
+      return bool(tFile);
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Marching-cubes case table. Corner c of a cell is offset by bit 0 of c along x, bit 1 along y and bit 2 along z,
+    * edge 4 * a + m runs along axis a from the corner whose other two bits are m. A case sets the bits of the corners
+    * with phi >= 0 and lists three edges per triangle, facing the positive side
+    */
+   struct MarchingCubesTable
+   {
+      int mEdgeCorners[12][2];
+      std::vector<std::uint8_t> mTriangles[256];
+   };
+
+   /**
+    * Gets the marching-cubes table, built on first use by tracing the surface of every case across the six faces of the
+    * cell. Where a face is ambiguous its positive corners are kept apart, which only depends on the face itself, so
+    * neighboring cells always agree on the segments of their shared face and the surface has no cracks
+    */
+   const MarchingCubesTable &marching_cubes_table()
+   {
+      static const MarchingCubesTable tTable = []()
+      {
+         MarchingCubesTable tTable;
+         for (int iAxis = 0; iAxis < 3; iAxis++)
+         {
+            int tLow = std::min((iAxis + 1) % 3, (iAxis + 2) % 3);
+            int tHigh = std::max((iAxis + 1) % 3, (iAxis + 2) % 3);
+            for (int m = 0; m < 4; m++)
+            {
+               int tStart = (m & 1) << tLow | (m >> 1) << tHigh;
+               tTable.mEdgeCorners[4 * iAxis + m][0] = tStart;
+               tTable.mEdgeCorners[4 * iAxis + m][1] = tStart | 1 << iAxis;
+            }
+         }
+
+         // Edge between two corners that differ in one bit
+         auto tEdge = [](int c0, int c1)
+         {
+            int tAxis = __builtin_ctz(c0 ^ c1);
+            int tStart = c0 & c1;
+            int tLow = std::min((tAxis + 1) % 3, (tAxis + 2) % 3);
+            int tHigh = std::max((tAxis + 1) % 3, (tAxis + 2) % 3);
+            return 4 * tAxis + ((tStart >> tLow) & 1) + 2 * ((tStart >> tHigh) & 1);
+         };
+
+         for (int iCase = 0; iCase < 256; iCase++)
+         {
+            // Every face contributes segments from the edge where its boundary leaves the positive corners to the edge
+            // where it entered them, going counterclockwise seen from outside the cell. Every crossed edge is left on one
+            // of its faces and entered on the other, so following the segments closes loops around the cell
+            int tNext[12];
+            std::fill(tNext, tNext + 12, -1);
+            for (int iAxis = 0; iAxis < 3; iAxis++)
+            {
+               for (int iSide = 0; iSide < 2; iSide++)
+               {
+                  int u = 1 << (iAxis + 1) % 3;
+                  int v = 1 << (iAxis + 2) % 3;
+                  int c0 = iSide << iAxis;
+                  int c[4] = {c0, c0 | u, c0 | u | v, c0 | v};
+                  if (iSide == 0)
+                  {
+                     std::swap(c[1], c[3]); // Seen from outside the lower face turns the other way
+                  }
+
+                  bool tPositive[4];
+                  for (int k = 0; k < 4; k++)
+                  {
+                     tPositive[k] = (iCase >> c[k]) & 1;
+                  }
+                  for (int k = 0; k < 4; k++)
+                  {
+                     if (!tPositive[k] || tPositive[(k + 1) % 4])
+                     {
+                        continue;
+                     }
+
+                     // The boundary left the positive corners on edge k, it entered them on the closest edge before
+                     for (int iBack = 1; iBack < 4; iBack++)
+                     {
+                        int e = (k + 4 - iBack) % 4;
+                        if (!tPositive[e] && tPositive[(e + 1) % 4])
+                        {
+                           tNext[tEdge(c[k], c[(k + 1) % 4])] = tEdge(c[e], c[(e + 1) % 4]);
+                           break;
+                        }
+                     }
+                  }
+               }
+            }
+
+            // Fans of triangles over every loop
+            bool tVisited[12] = {};
+            for (int iEdge = 0; iEdge < 12; iEdge++)
+            {
+               if (tNext[iEdge] < 0 || tVisited[iEdge])
+               {
+                  continue;
+               }
+               std::vector<int> tLoop;
+               for (int e = iEdge; !tVisited[e]; e = tNext[e])
+               {
+                  tVisited[e] = true;
+                  tLoop.push_back(e);
+               }
+               for (size_t iV = 1; iV + 1 < tLoop.size(); iV++)
+               {
+                  tTable.mTriangles[iCase].insert(tTable.mTriangles[iCase].end(), {std::uint8_t(tLoop[0]), std::uint8_t(tLoop[iV]), std::uint8_t(tLoop[iV + 1])});
+               }
+            }
+         }
+         return tTable;
+      }();
+      return tTable;
+   }
+
+   //-----------------------------------------------------------------------
+
+   /**
+    * Coordinates of the volume grid along x, y and z
+    */
+   void volume_coordinates(std::vector<double> &aXs, std::vector<double> &aYs, std::vector<double> &aZs)
+   {
+      aXs.resize(VOLUME_POINTS);
+      aYs.resize(VOLUME_POINTS);
+      aZs.resize(VOLUME_POINTS);
+      linspace(aXs, gXLB, gXUB);
+      linspace(aYs, gZLB, gZUB);
+      linspace(aZs, gZLB, gZUB);
+   }
 
-            gPhaseTable[aPhaseIdx] = tPhaseValue;
-
-            // Ensure the phase is in the list to plot
-            if (std::find(gPhasesToPlot.begin(), gPhasesToPlot.end(), tPhaseValue) == gPhasesToPlot.end())
-            {
-               gPhasesToPlot.push_back(tPhaseValue);
-            }
+   //-----------------------------------------------------------------------
 
-            // Clear selection
-            gSelectedBitset = MORIS_UINT_MAX;
+   /**
+    * Gets the volume of a level-set from the volume cache, sampling it on the evaluation pool one z-layer per task
+    * if its expression, parameters or the domain changed
+    */
+   const VolumeField &get_volume(const LS &aLS)
+   {
+      FieldKey tKey = field_key(aLS, 1, SAMPLING::VALUES, 0.0);
+      VolumeField *tFound = nullptr;
+      VolumeField *tOldest = &gVolumeCache[0];
+      for (VolumeField &tVolume : gVolumeCache)
+      {
+         if (tVolume.mVersion != 0 && tVolume.mKey == tKey)
+         {
+            tFound = &tVolume;
+            break;
          }
-         else
+         if (tVolume.mLastUsed < tOldest->mLastUsed)
          {
-            // Reject input - print message
-            std::cout << "Invalid phase value entered.\n";
+            tOldest = &tVolume;
          }
       }
+
+      if (!tFound)
+      {
+         tFound = tOldest;
+         tFound->mKey = tKey;
+         tFound->mVersion = ++gFieldVersion;
+         tFound->mPhi.resize(VOLUME_POINTS * VOLUME_POINTS * VOLUME_POINTS);
+
+         std::vector<double> tXs, tYs, tZs;
+         volume_coordinates(tXs, tYs, tZs);
+         FieldBuffer<FieldValue> tNoGradient;
+         thread_pool().parallel_for(VOLUME_POINTS, [&](uint aLayer)
+                                    {
+            SampleTarget<FieldValue> tTarget(tFound->mPhi, tNoGradient, aLayer * VOLUME_POINTS * VOLUME_POINTS, VOLUME_POINTS * VOLUME_POINTS);
+            eval_LS_grid(aLS, tXs.data(), VOLUME_POINTS, tYs.data(), VOLUME_POINTS, tZs[aLayer], tTarget.mPhi);
+            tTarget.store(); });
+      }
+      tFound->mLastUsed = gFrame;
+      return *tFound;
    }
 
    //-----------------------------------------------------------------------
 
-   void drawLS(const LS &aLS, PHASE aSign, int aColorIndex)
+   /**
+    * Extracts the zero isosurface of a volume with marching cubes. Slabs of z-layers run on the thread pool, first
+    * placing a vertex on every crossed grid edge that starts in their layers, interpolating phi linearly along the edge
+    * and its central-difference gradient for the normal, then looking up the vertices of the triangles of their cells
+    * by edge, so every vertex is shared by all cells around its edge
+    */
+   void extract_isosurface(const VolumeField &aVolume, VolumeSurface &aSurface)
    {
-      // Check if we need to plot this geometry
-      if (aSign == PHASE::NONE)
+      const int n = VOLUME_POINTS;
+      const size_t tNumPoints = size_t(n) * n * n;
+      const size_t tStrides[3] = {size_t(n), 1, size_t(n) * n}; // Point index steps along x, y and z
+      const uint tNumSlabs = (n - 1 + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+      const MarchingCubesTable &tTable = marching_cubes_table();
+      const FieldBuffer<FieldValue> &tPhi = aVolume.mPhi;
+
+      std::vector<double> tCoordinates[3];
+      volume_coordinates(tCoordinates[0], tCoordinates[1], tCoordinates[2]);
+      double tSpacing[3];
+      for (int iAxis = 0; iAxis < 3; iAxis++)
       {
-         return; // don't plot
+         tSpacing[iAxis] = tCoordinates[iAxis][1] - tCoordinates[iAxis][0];
       }
 
-      glPushMatrix();
-
-      // Reduce number of points for faster rendering
-      int tReductionFactor = 3;
-      int tNumPoints = NUM_POINTS / tReductionFactor;
-
-      std::vector<std::vector<double>> tPhiVals(tNumPoints, std::vector<double>(tNumPoints));
+      // Vertex of every crossed edge, numbered within the slab that owns the edge. Only crossed edges are read,
+      // the storage is kept between calls
+      thread_local std::vector<uint> tEdgeVertexStorage;
+      tEdgeVertexStorage.resize(3 * tNumPoints);
+      uint *tEdgeVertex = tEdgeVertexStorage.data();
 
-      // Evaluate level-set function at grid points, finite difference to get the normals for these points
-      for (int i = 0; i < tNumPoints; i++)
+      std::vector<VolumeSurface> tSlabs(tNumSlabs);
+      auto tSlabOf = [&](int aLayer)
       {
-         double x = gXVals[i * tReductionFactor];
-         for (int j = 0; j < tNumPoints; j++)
-         {
-            double z = gZVals[j * tReductionFactor];
-            tPhiVals[i][j] = eval_LS(aLS, x, z, gZ);
-         }
-      }
+         return std::min<uint>(aLayer / ROWS_PER_TASK, tNumSlabs - 1);
+      };
 
-      // Normal y component (down) for every vertex
-      double ny = -1.0;
+      thread_pool().parallel_for(tNumSlabs, [&](uint aSlab)
+                                 {
+         VolumeSurface &tSlab = tSlabs[aSlab];
+         int tLayerBegin = aSlab * ROWS_PER_TASK;
+         int tLayerEnd = aSlab + 1 == tNumSlabs ? n : tLayerBegin + ROWS_PER_TASK;
 
-      // Draw the surface, splitting triangle strips when vertices don't match sign condition
-      for (int i = 0; i < tNumPoints - 1; i++)
-      {
-         bool stripOpen = false;
-         double x0 = gXVals[i * tReductionFactor];
-         double x1 = gXVals[(i + 1) * tReductionFactor];
-         for (int j = 0; j < tNumPoints; j++)
+         // Central differences inside the volume, one-sided on its boundary
+         auto tGradient = [&](const int *aIndex, size_t aPoint, double *aGradient)
          {
-            double z = gZVals[j * tReductionFactor]; // Since OpenGL Y is up, we use Z here. LS function is still (x,y)
-            double y0 = tPhiVals[i][j];
-            double y1 = tPhiVals[i + 1][j];
-
-            bool tValid0 = !((aSign == PHASE::POSITIVE && y0 < 0) || (aSign == PHASE::NEGATIVE && y0 > 0));
-            bool tValid1 = !((aSign == PHASE::POSITIVE && y1 < 0) || (aSign == PHASE::NEGATIVE && y1 > 0));
+            for (int iAxis = 0; iAxis < 3; iAxis++)
+            {
+               size_t tLow = aIndex[iAxis] > 0 ? aPoint - tStrides[iAxis] : aPoint;
+               size_t tHigh = aIndex[iAxis] < n - 1 ? aPoint + tStrides[iAxis] : aPoint;
+               double tSteps = (tHigh - tLow) / tStrides[iAxis];
+               aGradient[iAxis] = (tPhi[tHigh] - tPhi[tLow]) / (tSteps * tSpacing[iAxis]);
+            }
+         };
 
-            // If both vertices are valid, emit them into the strip.
-            // If exactly one is valid, compute the zero-level crossing along the edge
-            // and emit that intersection in place of the invalid vertex.
-            if (tValid0 || tValid1)
+         for (int k = tLayerBegin; k < tLayerEnd; k++)
+         {
+            for (int i = 0; i < n; i++)
             {
-               if (!stripOpen)
+               for (int j = 0; j < n; j++)
                {
-                  glBegin(GL_TRIANGLE_STRIP);
-                  stripOpen = true;
-               }
+                  int tIndex[3] = {i, j, k};
+                  size_t tPoint = (size_t(k) * n + i) * n + j;
+                  double tPhi0 = tPhi[tPoint];
+                  for (int iAxis = 0; iAxis < 3; iAxis++)
+                  {
+                     size_t tEnd = tPoint + tStrides[iAxis];
+                     if (tIndex[iAxis] == n - 1 || (tPhi0 >= 0) == (tPhi[tEnd] >= 0))
+                     {
+                        continue;
+                     }
 
-               // Set color for this geometry
-               glColor3d(gColors[aColorIndex][0], gColors[aColorIndex][1], gColors[aColorIndex][2]);
+                     double t = tPhi0 / (tPhi0 - tPhi[tEnd]);
+                     t = t >= 0.0 && t <= 1.0 ? t : 0.5;
+                     int tEndIndex[3] = {i, j, k};
+                     tEndIndex[iAxis]++;
+                     double tGradient0[3], tGradient1[3], tNormal[3];
+                     tGradient(tIndex, tPoint, tGradient0);
+                     tGradient(tEndIndex, tEnd, tGradient1);
+                     double tLength = 0.0;
+                     for (int iDim = 0; iDim < 3; iDim++)
+                     {
+                        tNormal[iDim] = (1.0 - t) * tGradient0[iDim] + t * tGradient1[iDim];
+                        tLength += tNormal[iDim] * tNormal[iDim];
+                     }
+                     tLength = tLength > 0.0 ? std::sqrt(tLength) : 1.0;
+
+                     size_t tEdge = iAxis * tNumPoints + tPoint;
+                     tEdgeVertex[tEdge] = tSlab.mIsosurface.num_vertices();
+                     tSlab.mIsosurface.mVertices.insert(tSlab.mIsosurface.mVertices.end(),
+                                                        {tCoordinates[0][i] + (iAxis == 0 ? t * tSpacing[0] : 0.0),
+                                                         tCoordinates[1][j] + (iAxis == 1 ? t * tSpacing[1] : 0.0),
+                                                         tCoordinates[2][k] + (iAxis == 2 ? t * tSpacing[2] : 0.0)});
+                     tSlab.mIsosurface.mNormals.insert(tSlab.mIsosurface.mNormals.end(),
+                                                       {tNormal[0] / tLength, tNormal[1] / tLength, tNormal[2] / tLength});
+                     tSlab.mVertexEdges.push_back(tEdge);
+                     tSlab.mVertexWeights.push_back(t);
+                  }
+               }
+            }
+         } });
 
-               // finite difference epsilon for normals
-               double tEps = 1e-6;
+      // Slabs number their vertices after the vertices of the slabs before them
+      std::vector<uint> tOffsets(tNumSlabs + 1, 0);
+      for (uint iSlab = 0; iSlab < tNumSlabs; iSlab++)
+      {
+         tOffsets[iSlab + 1] = tOffsets[iSlab] + tSlabs[iSlab].mIsosurface.num_vertices();
+      }
 
-               if (tValid0 && tValid1)
-               {
-                  // both vertices are in the desired plotting domain
-                  double tdPhidx0 = eval_LS(aLS, x0 + tEps, z, gZ) - eval_LS(aLS, x0 - tEps, z, gZ);
-                  double tdPhidx1 = eval_LS(aLS, x1 + tEps, z, gZ) - eval_LS(aLS, x1 - tEps, z, gZ);
-                  double tdPhidz0 = eval_LS(aLS, x0, z + tEps, gZ) - eval_LS(aLS, x0, z - tEps, gZ);
-                  double tdPhidz1 = eval_LS(aLS, x1, z + tEps, gZ) - eval_LS(aLS, x1, z - tEps, gZ);
-
-                  double nx0 = 0.5 * tdPhidx0 / tEps;
-                  double nz0 = 0.5 * tdPhidz0 / tEps;
-                  double len0 = std::sqrt(nx0 * nx0 + ny * ny + nz0 * nz0);
-
-                  double nx1 = 0.5 * tdPhidx1 / tEps;
-                  double nz1 = 0.5 * tdPhidz1 / tEps;
-                  double len1 = std::sqrt(nx1 * nx1 + ny * ny + nz1 * nz1);
-
-                  glNormal3d(nx0 / len0, ny / len0, nz0 / len0);
-                  glVertex3d(x0, y0, z);
-                  glNormal3d(nx1 / len1, ny / len1, nz1 / len1);
-                  glVertex3d(x1, y1, z);
-               }
-               else if (gIsocontour)
+      thread_pool().parallel_for(tNumSlabs, [&](uint aSlab)
+                                 {
+         std::vector<uint> &tIndices = tSlabs[aSlab].mIsosurface.mIndices;
+         int tLayerBegin = aSlab * ROWS_PER_TASK;
+         int tLayerEnd = std::min(tLayerBegin + ROWS_PER_TASK, n - 1);
+         for (int k = tLayerBegin; k < tLayerEnd; k++)
+         {
+            for (int i = 0; i < n - 1; i++)
+            {
+               for (int j = 0; j < n - 1; j++)
                {
-                  // Sign change, compute intersection root along x0-x1 edge
-                  double tXLow = y0 < 0 ? x0 : x1;
-                  double tXHigh = y0 < 0 ? x1 : x0;
-                  double tXRoot = bisect(aLS, tXLow, tXHigh, z);
-
-                  // compute normal at root (phi ~ 0)
-                  double tdPhidxR = eval_LS(aLS, tXRoot + tEps, z, gZ) - eval_LS(aLS, tXRoot - tEps, z, gZ);
-                  double tdPhidzR = eval_LS(aLS, tXRoot, z + tEps, gZ) - eval_LS(aLS, tXRoot, z - tEps, gZ);
-                  double nxr = 0.5 * tdPhidxR / tEps;
-                  double nzr = 0.5 * tdPhidzR / tEps;
-                  double lenr = std::sqrt(nxr * nxr + ny * ny + nzr * nzr);
+                  size_t tCell = (size_t(k) * n + i) * n + j;
+                  uint tCase = 0;
+                  for (int iC = 0; iC < 8; iC++)
+                  {
+                     size_t tCorner = tCell + (iC & 1) * tStrides[0] + (iC >> 1 & 1) * tStrides[1] + (iC >> 2) * tStrides[2];
+                     tCase |= tPhi[tCorner] >= 0 ? 1u << iC : 0u;
+                  }
 
-                  if (tValid0)
+                  for (std::uint8_t tCellEdge : tTable.mTriangles[tCase])
                   {
-                     // Plot vertex 0 and root
-                     double tdPhidx0 = eval_LS(aLS, x0 + tEps, z, gZ) - eval_LS(aLS, x0 - tEps, z, gZ);
-                     double tdPhidz0 = eval_LS(aLS, x0, z + tEps, gZ) - eval_LS(aLS, x0, z - tEps, gZ);
-                     double nx0 = 0.5 * tdPhidx0 / tEps;
-                     double nz0 = 0.5 * tdPhidz0 / tEps;
-                     double len0 = std::sqrt(nx0 * nx0 + ny * ny + nz0 * nz0);
+                     int tStart = tTable.mEdgeCorners[tCellEdge][0];
+                     size_t tPoint = tCell + (tStart & 1) * tStrides[0] + (tStart >> 1 & 1) * tStrides[1] + (tStart >> 2) * tStrides[2];
+                     size_t tEdge = (tCellEdge / 4) * tNumPoints + tPoint;
+                     tIndices.push_back(tOffsets[tSlabOf(k + (tStart >> 2))] + tEdgeVertex[tEdge]);
+                  }
+               }
+            }
+         } });
 
-                     glNormal3d(nx0 / len0, ny / len0, nz0 / len0);
-                     glVertex3d(x0, y0, z);
+      TriangleMesh &tMesh = aSurface.mIsosurface;
+      tMesh.clear();
+      aSurface.mVertexEdges.clear();
+      aSurface.mVertexWeights.clear();
+      for (VolumeSurface &tSlab : tSlabs)
+      {
+         tMesh.mVertices.insert(tMesh.mVertices.end(), tSlab.mIsosurface.mVertices.begin(), tSlab.mIsosurface.mVertices.end());
+         tMesh.mNormals.insert(tMesh.mNormals.end(), tSlab.mIsosurface.mNormals.begin(), tSlab.mIsosurface.mNormals.end());
+         tMesh.mIndices.insert(tMesh.mIndices.end(), tSlab.mIsosurface.mIndices.begin(), tSlab.mIsosurface.mIndices.end());
+         aSurface.mVertexEdges.insert(aSurface.mVertexEdges.end(), tSlab.mVertexEdges.begin(), tSlab.mVertexEdges.end());
+         aSurface.mVertexWeights.insert(aSurface.mVertexWeights.end(), tSlab.mVertexWeights.begin(), tSlab.mVertexWeights.end());
+      }
+   }
 
-                     glNormal3d(nxr / lenr, ny / lenr, nzr / lenr);
-                     glVertex3d(tXRoot, 0.0, z);
-                  }
-                  else
-                  {
-                     // Plot root and vertex 1
-                     glNormal3d(nxr / lenr, ny / lenr, nzr / lenr);
-                     glVertex3d(tXRoot, 0.0, z);
+   //-----------------------------------------------------------------------
 
-                     double tdPhidx1 = eval_LS(aLS, x1 + tEps, z, gZ) - eval_LS(aLS, x1 - tEps, z, gZ);
-                     double tdPhidz1 = eval_LS(aLS, x1, z + tEps, gZ) - eval_LS(aLS, x1, z - tEps, gZ);
-                     double nx1 = 0.5 * tdPhidx1 / tEps;
-                     double nz1 = 0.5 * tdPhidz1 / tEps;
-                     double len1 = std::sqrt(nx1 * nx1 + ny * ny + nz1 * nz1);
+   /**
+    * Clips the isosurface of geometry aGeom at the isosurfaces of all other geometries and sorts the pieces by the
+    * bitset of the other geometries on them, the bit of aGeom is 0. The other level-sets are interpolated along the grid
+    * edges of the isosurface vertices, and linearly along the triangle edges they cross. Vertices made on a triangle
+    * edge are shared by both triangles of the edge
+    */
+   void clip_isosurface(uint aGeom, const std::vector<const VolumeField *> &aVolumes, VolumeSurface &aSurface)
+   {
+      const uint tNumGeoms = aVolumes.size();
+      const uint tNumBitsets = 1u << tNumGeoms;
+      const size_t tNumPoints = size_t(VOLUME_POINTS) * VOLUME_POINTS * VOLUME_POINTS;
+      const size_t tStrides[3] = {VOLUME_POINTS, 1, size_t(VOLUME_POINTS) * VOLUME_POINTS};
+      const TriangleMesh &tIsosurface = aSurface.mIsosurface;
+      TriangleMesh &tMesh = aSurface.mBoundary;
+      tMesh.mVertices = tIsosurface.mVertices;
+      tMesh.mNormals = tIsosurface.mNormals;
+
+      // Values of all level-sets at every vertex, tNumGeoms per vertex
+      std::vector<double> tValues(tNumGeoms * tIsosurface.num_vertices(), 0.0);
+      for (uint iV = 0; iV < tIsosurface.num_vertices(); iV++)
+      {
+         size_t tStart = aSurface.mVertexEdges[iV] % tNumPoints;
+         size_t tEnd = tStart + tStrides[aSurface.mVertexEdges[iV] / tNumPoints];
+         double t = aSurface.mVertexWeights[iV];
+         for (uint iG = 0; iG < tNumGeoms; iG++)
+         {
+            tValues[tNumGeoms * iV + iG] = iG == aGeom ? 0.0 : (1.0 - t) * aVolumes[iG]->mPhi[tStart] + t * aVolumes[iG]->mPhi[tEnd];
+         }
+      }
 
-                     glNormal3d(nx1 / len1, ny / len1, nz1 / len1);
-                     glVertex3d(x1, y1, z);
-                  }
-               }
+      // Vertex where a triangle edge crosses the isosurface of a geometry, made once for both triangles of the edge
+      std::vector<std::unordered_map<std::uint64_t, uint>> tCrossings(tNumGeoms);
+      auto tCrossing = [&](uint a, uint b, uint aOther)
+      {
+         if (a > b)
+         {
+            std::swap(a, b);
+         }
+         auto tInserted = tCrossings[aOther].emplace(std::uint64_t(a) << 32 | b, tMesh.num_vertices());
+         if (tInserted.second)
+         {
+            double t = tValues[tNumGeoms * a + aOther] / (tValues[tNumGeoms * a + aOther] - tValues[tNumGeoms * b + aOther]);
+            for (uint iDim = 0; iDim < 3; iDim++)
+            {
+               tMesh.mVertices.push_back((1.0 - t) * tMesh.mVertices[3 * a + iDim] + t * tMesh.mVertices[3 * b + iDim]);
+               tMesh.mNormals.push_back((1.0 - t) * tMesh.mNormals[3 * a + iDim] + t * tMesh.mNormals[3 * b + iDim]);
             }
-            else
+            for (uint iG = 0; iG < tNumGeoms; iG++)
             {
-               // both invalid: close strip if open
-               if (stripOpen)
+               tValues.push_back((1.0 - t) * tValues[tNumGeoms * a + iG] + t * tValues[tNumGeoms * b + iG]);
+            }
+         }
+         return tInserted.first->second;
+      };
+
+      // A piece of a triangle, with the bits of the geometries it has been clipped by so far
+      struct Piece
+      {
+         std::vector<uint> mVertices;
+         Bitset mBitset;
+      };
+      std::vector<std::vector<uint>> tPatches(tNumBitsets);
+      std::vector<Piece> tPieces, tNextPieces;
+      for (uint iT = 0; iT < tIsosurface.num_triangles(); iT++)
+      {
+         const uint *tTriangle = &tIsosurface.mIndices[3 * iT];
+         tPieces.assign(1, {{tTriangle[0], tTriangle[1], tTriangle[2]}, 0});
+         for (uint iG = 0; iG < tNumGeoms; iG++)
+         {
+            if (iG == aGeom)
+            {
+               continue;
+            }
+            Bitset tBit = geometry_bit(iG, tNumGeoms);
+            tNextPieces.clear();
+            for (Piece &tPiece : tPieces)
+            {
+               Piece tPositive = {{}, static_cast<Bitset>(tPiece.mBitset | tBit)};
+               Piece tNegative = {{}, tPiece.mBitset};
+               size_t tNumVerts = tPiece.mVertices.size();
+               for (size_t iV = 0; iV < tNumVerts; iV++)
+               {
+                  uint a = tPiece.mVertices[iV];
+                  uint b = tPiece.mVertices[(iV + 1) % tNumVerts];
+                  bool tPositiveA = tValues[tNumGeoms * a + iG] >= 0;
+                  bool tPositiveB = tValues[tNumGeoms * b + iG] >= 0;
+                  (tPositiveA ? tPositive : tNegative).mVertices.push_back(a);
+                  if (tPositiveA != tPositiveB)
+                  {
+                     uint tCut = tCrossing(a, b, iG);
+                     tPositive.mVertices.push_back(tCut);
+                     tNegative.mVertices.push_back(tCut);
+                  }
+               }
+               for (Piece *tSide : {&tPositive, &tNegative})
                {
-                  glEnd();
-                  stripOpen = false;
+                  if (tSide->mVertices.size() >= 3)
+                  {
+                     tNextPieces.push_back(std::move(*tSide));
+                  }
                }
             }
+            tPieces.swap(tNextPieces);
          }
-         if (stripOpen)
+
+         for (const Piece &tPiece : tPieces)
          {
-            glEnd();
-            stripOpen = false;
+            for (size_t iV = 1; iV + 1 < tPiece.mVertices.size(); iV++)
+            {
+               tPatches[tPiece.mBitset].insert(tPatches[tPiece.mBitset].end(),
+                                               {tPiece.mVertices[0], tPiece.mVertices[iV], tPiece.mVertices[iV + 1]});
+            }
          }
       }
 
-      glPopMatrix();
-
-      ErrCheck("drawLS");
+      tMesh.mIndices.clear();
+      aSurface.mPatchStarts.assign(1, 0);
+      for (uint iB = 0; iB < tNumBitsets; iB++)
+      {
+         tMesh.mIndices.insert(tMesh.mIndices.end(), tPatches[iB].begin(), tPatches[iB].end());
+         aSurface.mPatchStarts.push_back(tMesh.mIndices.size());
+      }
    }
 
    //-----------------------------------------------------------------------
 
    /**
-    * Draws only regions that satisfy the bitset for the all the geometries
+    * Brings the isosurfaces of the 3-D view up to date. Volumes come from the volume cache, an isosurface is only
+    * extracted again when its volume changed and the isosurfaces are only clipped again when any volume changed.
+    * Rotating the view and phase table edits don't get here, they only change how the cached surfaces are drawn
     */
-   void draw_LS_projection(std::vector<LS> &aLevelSets, std::vector<int> &aBitset, int aColorIndex, uint aTexture = MORIS_UINT_MAX)
+   void update_volume_surfaces()
    {
-      if (aBitset.size() != gNumGeoms)
+      std::vector<uint> tGenerations = gScene.generations({SCENE::GEOMETRY, SCENE::PARAMETERS});
+      if (tGenerations == gVolumeGenerations && gVolumeVersions.size() == gNumGeoms)
       {
-         Fatal("draw_LS_projection: Bitset size does not match number of level-sets");
+         return;
       }
 
-      // Check if this phase has a projection texture
-      if (aTexture != MORIS_UINT_MAX)
+      std::vector<const VolumeField *> tVolumes(gNumGeoms);
+      std::vector<uint> tVersions(gNumGeoms);
+      for (uint iG = 0; iG < gNumGeoms; iG++)
       {
-         glEnable(GL_TEXTURE_2D);
-         glBindTexture(GL_TEXTURE_2D, aTexture);
-         glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+         tVolumes[iG] = &get_volume(gLevelSets[iG]);
+         tVersions[iG] = tVolumes[iG]->mVersion;
       }
 
-      glPushMatrix();
-
-      // Need to evaluate all level-sets at each vertex
-      std::vector<std::vector<std::vector<double>>> tPhiVals(aLevelSets.size(), std::vector<std::vector<double>>(NUM_POINTS, std::vector<double>(NUM_POINTS)));
-
-      // Evaluate all level-sets at each vertex
-      for (size_t iG = 0; iG < aLevelSets.size(); iG++)
+      for (uint iG = 0; iG < gNumGeoms; iG++)
       {
-         for (int iX = 0; iX < NUM_POINTS; iX++)
+         if (gVolumeSurfaces[iG].mFieldVersion != tVersions[iG])
          {
-            double x = gXVals[iX];
-            for (int iY = 0; iY < NUM_POINTS; iY++)
-            {
-               double z = gZVals[iY];
-               tPhiVals[iG][iX][iY] = eval_LS(aLevelSets[iG], x, z, gZ);
-            }
+            extract_isosurface(*tVolumes[iG], gVolumeSurfaces[iG]);
+            gVolumeSurfaces[iG].mFieldVersion = tVersions[iG];
          }
       }
 
-      // Draw the surface, splitting triangle strips when vertices don't match sign condition
-      for (int i = 0; i < NUM_POINTS - 1; i++)
+      if (tVersions != gVolumeVersions)
       {
-         bool stripOpen = false;
-         double x0 = gXVals[i];
-         double x1 = gXVals[i + 1];
+         thread_pool().parallel_for(gNumGeoms, [&](uint aGeom)
+                                    { clip_isosurface(aGeom, tVolumes, gVolumeSurfaces[aGeom]); });
+         gVolumeVersions = tVersions;
+      }
+      gVolumeGenerations = tGenerations;
+   }
+
+   //-----------------------------------------------------------------------
 
-         for (int j = 0; j < NUM_POINTS; j++)
+   /**
+    * Draws the phase boundaries of the 3-D view. A piece of an isosurface is drawn if the phases on its two sides differ
+    * and one of them is plotted, in the color of that phase, preferring the positive side. Level-set coordinates (x,y,z)
+    * are drawn at (x,z,y) so z is up, and the current z-slice is outlined
+    */
+   void draw_volume_surfaces()
+   {
+      const std::vector<bool> &tVisible = visible_bitsets();
+      for (uint iG = 0; iG < gNumGeoms; iG++)
+      {
+         if (gGeomsPhaseToPlot[iG] == PHASE::NONE)
          {
-            // Per-vertex evaluation (do not mutate x0/x1)
-            double z = gZVals[j];
+            continue;
+         }
 
-            // Determine validity of each vertex by checking all geometries against the bitset
-            bool tValid0 = true;
-            bool tValid1 = true;
-            for (size_t iG = 0; iG < aLevelSets.size(); ++iG)
+         const VolumeSurface &tSurface = gVolumeSurfaces[iG];
+         const TriangleMesh &tMesh = tSurface.mBoundary;
+         Bitset tBit = geometry_bit(iG);
+         for (uint iB = 0; iB + 1 < tSurface.mPatchStarts.size(); iB++)
+         {
+            uint tPositive = iB | tBit;
+            if (gPhaseTable[tPositive] == gPhaseTable[iB] || (!tVisible[tPositive] && !tVisible[iB]))
             {
-               double phi0 = tPhiVals[iG][i][j];
-               double phi1 = tPhiVals[iG][i + 1][j];
-               int want = aBitset[iG]; // 1 -> positive, 0 -> negative
-               if ((want == 1 && phi0 < 0) || (want == 0 && phi0 > 0))
-                  tValid0 = false;
-               if ((want == 1 && phi1 < 0) || (want == 0 && phi1 > 0))
-                  tValid1 = false;
+               continue;
             }
+            int tColor = gPhaseTable[tVisible[tPositive] ? tPositive : iB] % gColors.size();
+            glColor3d(gColors[tColor][0], gColors[tColor][1], gColors[tColor][2]);
 
-            if (tValid0 || tValid1)
-            {
-               if (!stripOpen)
-               {
-                  glBegin(GL_TRIANGLE_STRIP);
-                  stripOpen = true;
-               }
-
-               glColor3d(gColors[aColorIndex][0], gColors[aColorIndex][1], gColors[aColorIndex][2]);
-
-               // If both vertices valid, emit flat projection vertices (y=0)
-               if (tValid0 && tValid1)
-               {
-                  // Emit vertices with their texture coordinates
-                  double xi0 = (x0 - gXLB) / (gXUB - gXLB) - gScroll * 0.01;
-                  double xi1 = (x1 - gXLB) / (gXUB - gXLB) - gScroll * 0.01;
-                  double eta = (z - gZLB) / (gZUB - gZLB);
-
-                  glTexCoord2d(gXUB - xi0, eta);
-                  glVertex3d(x0, 0.0, z);
-                  glTexCoord2d(gXUB - xi1, eta);
-                  glVertex3d(x1, 0.0, z);
-               }
-               else if (gIsocontour)
-               {
-                  // Find the geometry that changes sign between the two vertices.
-                  // Use that geometry to compute the intersection root.
-                  int flipGeom = -1;
-                  for (size_t iG = 0; iG < aLevelSets.size(); ++iG)
-                  {
-                     double phi0 = tPhiVals[iG][i][j];
-                     double phi1 = tPhiVals[iG][i + 1][j];
-                     if ((phi0 >= 0) != (phi1 >= 0))
-                     {
-                        flipGeom = static_cast<int>(iG);
-                        break;
-                     }
-                  }
-
-                  if (flipGeom == -1)
-                  {
-                     // Shouldn't happen: fallback to closing the strip
-                     if (stripOpen)
-                     {
-                        glEnd();
-                        stripOpen = false;
-                     }
-                  }
-                  else
-                  {
-                     // Compute root along edge for the geometry that flips
-                     double phi0_flip = tPhiVals[flipGeom][i][j];
-                     double tXLow = (phi0_flip < 0) ? x0 : x1;
-                     double tXHigh = (phi0_flip < 0) ? x1 : x0;
-                     double tXRoot = bisect(aLevelSets[flipGeom], tXLow, tXHigh, z);
-
-                     // Emit vertices in strip order: valid vertex then root (or root then valid)
-                     if (tValid0)
-                     {
-                        // Emit vertices with their texture coordinates
-                        double xi0 = (x0 - gXLB) / (gXUB - gXLB) - gScroll * 0.01;
-                        double xiR = (tXRoot - gXLB) / (gXUB - gXLB) - gScroll * 0.01;
-                        double eta = (z - gZLB) / (gZUB - gZLB);
-
-                        glTexCoord2d(gXUB - xi0, eta);
-                        glVertex3d(x0, 0.0, z);
-                        glTexCoord2d(gXUB - xiR, eta);
-                        glVertex3d(tXRoot, 0.0, z);
-                     }
-                     else
-                     {
-                        // Emit vertices with their texture coordinates
-                        double xiR = (tXRoot - gXLB) / (gXUB - gXLB) - gScroll * 0.01;
-                        double xi1 = (x1 - gXLB) / (gXUB - gXLB) - gScroll * 0.01;
-                        double eta = (z - gZLB) / (gZUB - gZLB);
-
-                        glTexCoord2d(gXUB - xiR, eta);
-                        glVertex3d(tXRoot, 0.0, z);
-                        glTexCoord2d(gXUB - xi1, eta);
-                        glVertex3d(x1, 0.0, z);
-                     }
-                  }
-               }
-            }
-            else
+            glBegin(GL_TRIANGLES);
+            for (uint iI = tSurface.mPatchStarts[iB]; iI < tSurface.mPatchStarts[iB + 1]; iI++)
             {
-               if (stripOpen)
-               {
-                  glEnd();
-                  stripOpen = false;
-               }
+               const double *tVertex = &tMesh.mVertices[3 * tMesh.mIndices[iI]];
+               const double *tNormal = &tMesh.mNormals[3 * tMesh.mIndices[iI]];
+               glNormal3d(tNormal[0], tNormal[2], tNormal[1]);
+               glVertex3d(tVertex[0], tVertex[2], tVertex[1]);
             }
-         }
-         if (stripOpen)
-         {
             glEnd();
-            stripOpen = false;
          }
       }
 
-      // Unbind texture
-      if (aTexture != MORIS_UINT_MAX)
-      {
-         glBindTexture(GL_TEXTURE_2D, 0);
-         glDisable(GL_TEXTURE_2D);
-      }
-
-      ErrCheck("draw_LS_projection");
+      glPushAttrib(GL_ENABLE_BIT);
+      glDisable(GL_LIGHTING);
+      glColor3f(1, 1, 1);
+      glBegin(GL_LINE_LOOP);
+      glVertex3d(gXLB, gZ, gZLB);
+      glVertex3d(gXUB, gZ, gZLB);
+      glVertex3d(gXUB, gZ, gZUB);
+      glVertex3d(gXLB, gZ, gZUB);
+      glEnd();
+      glPopAttrib();
 
-      glPopMatrix();
+      ErrCheck("draw_volume_surfaces");
    }
 
    //-----------------------------------------------------------------------
@@ -1186,6 +7449,9 @@ namespace moris::GUI
 
       // Plot all phases
       gPhasesToPlot = {0, 1, 2};
+
+      gScene.touch(SCENE::GEOMETRY);
+      gScene.touch(SCENE::PHASES);
    }
 
    //-----------------------------------------------------------------------
@@ -1195,6 +7461,13 @@ namespace moris::GUI
       // Clear the image
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+      // Advance the frame counter used by the field cache
+      gFrame++;
+      end_frame_root_stats();
+
+      // Keep the background input threads from replacing level-sets while they are drawn
+      std::lock_guard<std::mutex> lock(gLevelSetMutex);
+
       //-----------------------------------------------------------
       // Viewport 1 - Level set plotter
       //-----------------------------------------------------------
@@ -1261,10 +7534,30 @@ namespace moris::GUI
       else
          glDisable(GL_LIGHTING);
 
-      // Plot each level-set geometry
-      for (uint iG = 0; iG < gNumGeoms; iG++)
+      if (gSpatialDim == 3)
       {
-         drawLS(gLevelSets[iG], gGeomsPhaseToPlot[iG], iG);
+         // Isosurfaces on the volume grid, only extracted again when a geometry or parameter changed
+         update_volume_surfaces();
+         draw_volume_surfaces();
+      }
+      else
+      {
+         // Evaluate the fields of all plotted geometries together before drawing them
+         std::vector<const LS *> tPlotted;
+         for (uint iG = 0; iG < gNumGeoms; iG++)
+         {
+            if (gGeomsPhaseToPlot[iG] != PHASE::NONE)
+            {
+               tPlotted.push_back(&gLevelSets[iG]);
+            }
+         }
+         get_fields(tPlotted, PLOT_STRIDE, SAMPLING::GRADIENT);
+
+         // Plot each level-set geometry
+         for (uint iG = 0; iG < gNumGeoms; iG++)
+         {
+            drawLS(iG, gGeomsPhaseToPlot[iG], iG);
+         }
       }
 
       glDisable(GL_LIGHTING);   // No lighting for axes and text
@@ -1297,6 +7590,20 @@ namespace moris::GUI
       glWindowPos2i(5, 25);
       Print("Domain_x=[%f,%f] Domain_y=[%f,%f] z=%f Light=%s Lighting type=%s",
             gXLB, gXUB, gZLB, gZUB, gZ, gLight ? "On" : "Off", gSmooth ? "Smooth" : "Flat");
+      glWindowPos2i(5, 5);
+      Print("Roots=%u Evaluations/root=%.2f Over budget=%u ",
+            gLastRootStats.mRoots, gLastRootStats.mRoots ? double(gLastRootStats.mEvaluations) / gLastRootStats.mRoots : 0.0,
+            gLastRootStats.mOverBudget);
+      if (gRefinedOverlay)
+      {
+         double tUniformSamples = std::pow((1 << gQuadtreeDepth) + 1.0, 2) * std::max(gNumGeoms, 1u);
+         Print("Overlay depth=%d Samples=%zu (%.2f%% of uniform) Refined in %.1f ms%s", gQuadtreeDepth, gRefinedSamples,
+               100.0 * gRefinedSamples / tUniformSamples, gRefinedMilliseconds, gRefinedPending ? " (refining)" : "");
+      }
+      else
+      {
+         Print("Overlay=Off");
+      }
 
       //-----------------------------------------------------------
       // Viewport 2 (projection, top-down view)
@@ -1341,21 +7648,30 @@ namespace moris::GUI
          glRotated(-90.0, 1.0, 0.0, 0.0);
          glScaled(gScaleX, 1.0, gScaleZ);
 
-         // Plot the level-set geometries again, choose the color based on the phase table
-         for (size_t iBitset = 0; iBitset < (size_t)(1 << gNumGeoms); iBitset++)
+         const std::vector<bool> &tVisible = visible_bitsets();
+
+         // Classify the cached fields and extract the interfaces and polygons of every bitset, only needed when a field changed
+         update_interfaces();
+         if (gRefinedOverlay)
+         {
+            update_refined_overlay();
+         }
+
+         // Plot the visible bitsets, choose the color based on the phase table
+         for (size_t iBitset = 0; iBitset < tVisible.size(); iBitset++)
          {
-            if (std::find(gPhasesToPlot.begin(), gPhasesToPlot.end(), gPhaseTable[iBitset]) == gPhasesToPlot.end())
+            if (!tVisible[iBitset])
             {
                continue; // skip this phase, not in the list to plot
             }
 
-            // Get the bitset for this phase
-            Bitset tBinary = int_to_bitset(iBitset, gNumGeoms);
-
-            // Plot each geometry according to the bitset, using the color for this phase
-            draw_LS_projection(gLevelSets, tBinary, gPhaseTable[iBitset] % gColors.size(), iBitset == gSelectedBitset ? gTexture[0] : MORIS_UINT_MAX);
+            // Plot the polygons of this bitset, using the color for this phase
+            draw_LS_projection(iBitset, gPhaseTable[iBitset] % gColors.size(), iBitset == gSelectedBitset ? gTexture[0] : MORIS_UINT_MAX);
          }
 
+         // Outline the quadtree interfaces over the polygons
+         draw_interface_curves();
+
          // Print labels for the viewports
          glColor3f(1.0, 1.0, 1.0);
          if (gProjectionMain)
@@ -1393,6 +7709,9 @@ namespace moris::GUI
       // Clean up
       //-----------------------------------------------------------
 
+      // Sample the fields of this frame at the neighboring z-slices while the frame is shown
+      slice_sampler().submit(gZ, gFieldCache);
+
       // Error check
       ErrCheck("display");
 
@@ -1457,6 +7776,8 @@ namespace moris::GUI
             // reset phase table
             std::iota(gPhaseTable.begin(), gPhaseTable.end(), 0);
             gPhasesToPlot = gPhaseTable;
+            gScene.touch(SCENE::GEOMETRY);
+            gScene.touch(SCENE::PHASES);
          }
          else
          {
@@ -1466,6 +7787,7 @@ namespace moris::GUI
       else if (ch == 'i' || ch == 'I')
       {
          gIsocontour = 1 - gIsocontour;
+         gScene.touch(SCENE::ISOCONTOUR);
       }
       else if (ch == 'p' || ch == 'P')
       {
@@ -1516,20 +7838,29 @@ namespace moris::GUI
       {
          set_active_phases_from_phase_index(0); // since there's no F0 key
          gPhasesToPlot = {0};
+         gScene.touch(SCENE::PHASES);
       }
-      else if (ch == 'd' || ch == 'D')
+      else if ((ch == 'd' || ch == 'D') && gNumGeoms > 0)
       {
-         // Delete the current active geometry
-         // Shift all geometries after it down by one
-         for (uint iG = gActiveGeometry; iG < gNumGeoms - 1; iG++)
+         std::lock_guard<std::mutex> lock(gLevelSetMutex);
+
+         // Delete the current active geometry, or the last one if none is active
+         // Shift all geometries after it down by one, their fields and surfaces stay cached
+         uint tDeleted = std::min(gActiveGeometry, gNumGeoms - 1);
+         for (uint iG = tDeleted; iG < gNumGeoms - 1; iG++)
          {
             gLevelSets[iG] = gLevelSets[iG + 1];
             gGeomsPhaseToPlot[iG] = gGeomsPhaseToPlot[iG + 1];
+            std::swap(gSurfaceMeshes[iG], gSurfaceMeshes[iG + 1]);
+            std::swap(gVolumeSurfaces[iG], gVolumeSurfaces[iG + 1]);
          }
          gNumGeoms--;
          gLevelSets[gNumGeoms] = LS();               // Reset last geometry
          gGeomsPhaseToPlot[gNumGeoms] = PHASE::NONE; // Reset last geometry's phase to plot
 
+         // Drop its bit from the classified grid, the other geometries keep theirs
+         remove_classified_geometry(tDeleted);
+
          // reset phase table
          std::iota(gPhaseTable.begin(), gPhaseTable.end(), 0);
          gPhasesToPlot = gPhaseTable;
@@ -1539,6 +7870,8 @@ namespace moris::GUI
          {
             gGeomsPhaseToPlot[iG] = PHASE::ALL;
          }
+         gScene.touch(SCENE::GEOMETRY);
+         gScene.touch(SCENE::PHASES);
       }
       else if (ch == '+')
       {
@@ -1553,6 +7886,7 @@ namespace moris::GUI
          // Reset phase table
          std::iota(gPhaseTable.begin(), gPhaseTable.end(), 0);
          gPhasesToPlot = gPhaseTable;
+         gScene.touch(SCENE::PHASES);
       }
       else if (ch == 32) // space bar
       {
@@ -1572,6 +7906,7 @@ namespace moris::GUI
 
          // Reset active geometry
          gActiveGeometry = MORIS_UINT_MAX;
+         gScene.touch(SCENE::PHASES);
       }
       else if (ch == 13) // Enter key
       {
@@ -1580,9 +7915,7 @@ namespace moris::GUI
          {
             if (gProjectionMain)
             {
-               uint tPhaseIdxCopy = gSelectedBitset;
-               Bitset tBitsetCopy = int_to_bitset(tPhaseIdxCopy, gNumGeoms);
-               std::thread(prompt_and_update_phase, tPhaseIdxCopy, tBitsetCopy).detach();
+               std::thread(prompt_and_update_phase, static_cast<Bitset>(gSelectedBitset)).detach();
             }
             else
             {
@@ -1595,6 +7928,7 @@ namespace moris::GUI
                // Reset phase table
                std::iota(gPhaseTable.begin(), gPhaseTable.end(), 0);
                gPhasesToPlot = gPhaseTable;
+               gScene.touch(SCENE::PHASES);
             }
          }
          else if (gActiveGeometry != MORIS_UINT_MAX)
@@ -1608,18 +7942,66 @@ namespace moris::GUI
             // Reset phase table
             std::iota(gPhaseTable.begin(), gPhaseTable.end(), 0);
             gPhasesToPlot = gPhaseTable;
+            gScene.touch(SCENE::PHASES);
          }
          else if (gSelectedBitset != MORIS_UINT_MAX)
          {
-            uint tPhaseIdxCopy = gSelectedBitset;
-            Bitset tBitsetCopy = int_to_bitset(tPhaseIdxCopy, gNumGeoms);
-            std::thread(prompt_and_update_phase, tPhaseIdxCopy, tBitsetCopy).detach();
+            std::thread(prompt_and_update_phase, static_cast<Bitset>(gSelectedBitset)).detach();
          }
       }
       else if (ch == '/' || ch == '?')
       {
+         std::lock_guard<std::mutex> lock(gLevelSetMutex);
          load_demo();
       }
+      else if (ch == 'v' || ch == 'V')
+      {
+         // Switch the plotter between the height fields of the z-slice and the isosurfaces of the volume
+         gSpatialDim = gSpatialDim == 3 ? 2 : 3;
+      }
+      else if (ch == 'e' || ch == 'E')
+      {
+         // Export what the projection shows, extracting it first if nothing was drawn since the last change
+         std::lock_guard<std::mutex> lock(gLevelSetMutex);
+         update_interfaces();
+         const std::string tPath = "interfaces.vtk";
+         if (export_interfaces(tPath))
+         {
+            std::cout << "Wrote the interfaces and phases at z = " << gZ << " to " << tPath << std::endl;
+         }
+         else
+         {
+            std::cerr << "Failed to write " << tPath << ".\n";
+         }
+      }
+      else if (ch == 'k' || ch == 'K')
+      {
+         // Set a parameter value, which is read by the expressions without parsing them again
+         request_parameter_input_async();
+      }
+      else if (ch == '<' || ch == ',' || ch == '>' || ch == '.')
+      {
+         // Refine the overlay one level coarser or finer, it shows the last depth until the new one is refined
+         int tDepth = gQuadtreeDepth + (ch == '>' || ch == '.' ? 1 : -1);
+         if (tDepth >= QUADTREE_BASE && tDepth <= QUADTREE_MAX_DEPTH)
+         {
+            gQuadtreeDepth = tDepth;
+            std::cout << "Overlay quadtree depth " << gQuadtreeDepth << " (" << (1 << gQuadtreeDepth) << " cells across)" << std::endl;
+         }
+      }
+      else if (ch == 'o' || ch == 'O')
+      {
+         // Toggle the quadtree interfaces drawn over the projection
+         gRefinedOverlay = !gRefinedOverlay;
+      }
+      else if (ch == '[')
+      {
+         step_parameter(-1.0);
+      }
+      else if (ch == ']')
+      {
+         step_parameter(1.0);
+      }
       else if (ch == 27) // Escape key
          exit(0);
 
@@ -1630,6 +8012,7 @@ namespace moris::GUI
          int tGeomIndex = ch - '0';
          reset_active_phases();
          gGeomsPhaseToPlot[tGeomIndex] = PHASE::ALL;
+         gScene.touch(SCENE::PHASES);
       }
 
       glutPostRedisplay();
@@ -1734,6 +8117,12 @@ namespace moris::GUI
 
          glutPostRedisplay();
       }
+
+      // The function keys plot a single phase
+      if (key >= GLUT_KEY_F1 && key <= GLUT_KEY_F12)
+      {
+         gScene.touch(SCENE::PHASES);
+      }
    }
 
    //-----------------------------------------------------------------------
@@ -1810,12 +8199,13 @@ namespace moris::GUI
 
          if (button == 3) // Scroll up - make the plotting domain smaller
          {
-            gZ += 0.05;
+            gZ += SCROLL_STEP;
          }
          else if (button == 4) // Scroll down - zoom out
          {
-            gZ -= 0.05;
+            gZ -= SCROLL_STEP;
          }
+         gScene.touch(SCENE::SLICE);
 
          // Update the projection
          Project(0, gAsp, gDim);
@@ -1860,23 +8250,21 @@ namespace moris::GUI
          if (wx > gXLB && wx < gXUB && wz > gZLB && wz < gZUB)
          {
             // Get the bitset for the clicked point
-            Bitset tBitset(gNumGeoms);
+            std::lock_guard<std::mutex> lock(gLevelSetMutex);
+            Bitset tBitset = 0;
             for (uint iG = 0; iG < gNumGeoms; iG++)
             {
-               double phi = eval_LS(gLevelSets[iG], wx, wz, gZ);
-               tBitset[iG] = (phi >= 0) ? 1 : 0;
+               double phi;
+               eval_LS_batch(gLevelSets[iG], &wx, &wz, &gZ, &phi, 1);
+               tBitset |= (phi >= 0) ? geometry_bit(iG) : 0;
             }
 
-            uint tPhaseIndex = bitset_to_int(tBitset);
+            uint tPhaseIndex = tBitset;
 
             if (gSelectedBitset == MORIS_UINT_MAX)
             {
-               // Capture the bitset and phase index by value for the background thread
-               Bitset tBitsetCopy = tBitset;
-               uint tPhaseIdxCopy = tPhaseIndex;
-
                // To render texture for this bitset
-               gSelectedBitset = tPhaseIdxCopy;
+               gSelectedBitset = tPhaseIndex;
             }
             else if (gSelectedBitset == tPhaseIndex)
             {